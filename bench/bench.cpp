@@ -0,0 +1,191 @@
+#include "bench.hpp"
+#include "util.hpp"
+#include "third-party/json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <print>
+#include <stdexcept>
+#include <string>
+
+using json = nlohmann::json;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    using clock_type = std::chrono::steady_clock;
+
+    flo::bench::options g_options;
+
+    struct result {
+        std::string name;
+        int64_t iterations;
+        std::vector<double> seconds_per_iteration;
+    };
+
+    double seconds_for(const flo::bench::body& body, int64_t iterations) {
+        auto start = clock_type::now();
+        for (int64_t i = 0; i < iterations; ++i) {
+            body();
+        }
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+        return elapsed.count();
+    }
+
+    // grows the iteration count until one timed run lasts at least min_seconds.
+    int64_t calibrate(const flo::bench::body& body, double min_seconds) {
+        int64_t iterations = 1;
+        while (true) {
+            double seconds = seconds_for(body, iterations);
+            if (seconds >= min_seconds || iterations >= (int64_t{ 1 } << 30)) {
+                return iterations;
+            }
+            double scale = (seconds > 0.0) ? 1.4 * min_seconds / seconds : 10.0;
+            iterations = std::max(iterations + 1,
+                static_cast<int64_t>(static_cast<double>(iterations) * std::min(scale, 10.0)));
+        }
+    }
+
+    result run(const flo::bench::benchmark& bm) {
+        auto body = bm.make_body();
+        result res{ bm.name, calibrate(body, g_options.min_seconds), {} };
+        for (int i = 0; i < g_options.repetitions; ++i) {
+            res.seconds_per_iteration.push_back(
+                seconds_for(body, res.iterations) / static_cast<double>(res.iterations)
+            );
+        }
+        return res;
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        auto n = values.size();
+        return (n % 2) ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+    }
+
+    std::string format_time(double seconds) {
+        if (seconds >= 1.0) {
+            return std::format("{:.3f} s", seconds);
+        } else if (seconds >= 1e-3) {
+            return std::format("{:.3f} ms", seconds * 1e3);
+        } else if (seconds >= 1e-6) {
+            return std::format("{:.3f} us", seconds * 1e6);
+        }
+        return std::format("{:.1f} ns", seconds * 1e9);
+    }
+
+    void write_json(const std::string& fname, const std::vector<result>& results) {
+        json j;
+        j["context"] = {
+            { "min_seconds", g_options.min_seconds },
+            { "repetitions", g_options.repetitions },
+            { "scene_scale", g_options.scene_scale },
+            { "scene_iterations", g_options.scene_iterations }
+        };
+        j["benchmarks"] = json::array();
+        for (const auto& res : results) {
+            j["benchmarks"].push_back({
+                { "name", res.name },
+                { "iterations", res.iterations },
+                { "median_seconds", median(res.seconds_per_iteration) },
+                { "min_seconds", std::ranges::min(res.seconds_per_iteration) },
+                { "seconds", res.seconds_per_iteration }
+            });
+        }
+        std::ofstream out(fname);
+        if (!out) {
+            throw std::runtime_error("unable to write " + fname);
+        }
+        out << j.dump(4) << '\n';
+    }
+
+    void parse_args(int argc, char* argv[]) {
+        g_options.scene_dir = FLOWBEE_EXAMPLE_DIR;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--list") {
+                for (const auto& bm : flo::bench::registry()) {
+                    std::println("{}", bm.name);
+                }
+                std::exit(0);
+            }
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            std::string value = argv[++i];
+            if (arg == "--filter") {
+                g_options.filter = value;
+            } else if (arg == "--min-time") {
+                g_options.min_seconds = std::stod(value);
+            } else if (arg == "--repetitions") {
+                g_options.repetitions = std::max(std::stoi(value), 1);
+            } else if (arg == "--json") {
+                g_options.json_file = value;
+            } else if (arg == "--scene-scale") {
+                g_options.scene_scale = std::stod(value);
+            } else if (arg == "--scene-iterations") {
+                g_options.scene_iterations = std::stoi(value);
+            } else if (arg == "--scene-dir") {
+                g_options.scene_dir = value;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+    }
+
+}
+
+std::vector<flo::bench::benchmark>& flo::bench::registry() {
+    static std::vector<benchmark> benchmarks;
+    return benchmarks;
+}
+
+const flo::bench::options& flo::bench::current_options() {
+    return g_options;
+}
+
+void flo::bench::escape(const void* ptr) {
+    static const void* volatile sink;
+    sink = ptr;
+}
+
+flo::bench::registrar::registrar(const std::string& name, setup make_body) {
+    registry().push_back({ name, std::move(make_body) });
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::println("[error] {}", e.what());
+        std::println(" usage is 'flowbee_bench [--list] [--filter substring] [--min-time seconds] "
+            "[--repetitions n] [--json results.json] [--scene-scale k] [--scene-iterations n] "
+            "[--scene-dir dir]'");
+        return -1;
+    }
+
+    flo::set_rand_seed(1);
+
+    std::vector<result> results;
+    for (const auto& bm : flo::bench::registry()) {
+        if (bm.name.find(g_options.filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(run(bm));
+    }
+
+    // the scenes print their own progress, so the results are listed once all have run.
+    std::println("");
+    for (const auto& res : results) {
+        std::println("  {:<40} {:>12}  ({} iterations)",
+            res.name, format_time(median(res.seconds_per_iteration)), res.iterations);
+    }
+
+    if (!g_options.json_file.empty()) {
+        write_json(g_options.json_file, results);
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo::bench {
+
+    // a benchmark's setup runs once, untimed, and returns the body that is timed. The
+    // body is repeated until a run lasts at least options::min_seconds.
+
+    using body = std::function<void()>;
+    using setup = std::function<body()>;
+
+    struct benchmark {
+        std::string name;
+        setup make_body;
+    };
+
+    struct options {
+        std::string filter;
+        double min_seconds = 0.5;
+        int repetitions = 3;
+        std::string json_file;
+        double scene_scale = 0.25;
+        int scene_iterations = 200;
+        std::string scene_dir;
+    };
+
+    std::vector<benchmark>& registry();
+    const options& current_options();
+
+    struct registrar {
+        registrar(const std::string& name, setup make_body);
+    };
+
+    // defined out of line so that the compiler must assume it reads what it is passed.
+    void escape(const void* ptr);
+
+    // keeps a value from being optimized away.
+    template<typename T>
+    void do_not_optimize(const T& value) {
+        escape(&value);
+    }
+
+}
+
+#define FLO_BENCH_CONCAT_AUX(a, b) a##b
+#define FLO_BENCH_CONCAT(a, b) FLO_BENCH_CONCAT_AUX(a, b)
+
+// registers a benchmark; the braces that follow are its setup and must return its body.
+#define FLO_BENCHMARK(name) \
+    static flo::bench::body FLO_BENCH_CONCAT(flo_bench_setup_, __LINE__)(); \
+    static flo::bench::registrar FLO_BENCH_CONCAT(flo_bench_registrar_, __LINE__)( \
+        name, FLO_BENCH_CONCAT(flo_bench_setup_, __LINE__)); \
+    static flo::bench::body FLO_BENCH_CONCAT(flo_bench_setup_, __LINE__)()
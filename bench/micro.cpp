@@ -0,0 +1,253 @@
+#include "bench.hpp"
+#include "brush.hpp"
+#include "canvas.hpp"
+#include "diffusion.hpp"
+#include "image_encoders.hpp"
+#include "random.hpp"
+#include "thread_pool.hpp"
+#include "util.hpp"
+#include "vector_field.hpp"
+#include <filesystem>
+#include <memory>
+#include <ranges>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr int k_canvas_sz = 512;
+    constexpr int k_num_locs = 1024;
+    constexpr double k_radius = 10.0;
+    constexpr int k_num_masses = 500;
+
+    const std::vector<flo::rgb_color> k_palette = {
+        {0xf1, 0xfa, 0xee}, {0xa8, 0xda, 0xdc}, {0x45, 0x7b, 0x9d}, {0x1d, 0x35, 0x57}
+    };
+
+    const flo::dimensions k_dim = { k_canvas_sz, k_canvas_sz };
+
+    std::vector<flo::point> random_locs(const flo::dimensions& dim) {
+        flo::rng_stream rng(1);
+        std::vector<flo::point> locs(k_num_locs);
+        for (auto& loc : locs) {
+            loc = { rng.uniform(0.0, dim.wd - 1.0), rng.uniform(0.0, dim.hgt - 1.0) };
+        }
+        return locs;
+    }
+
+    flo::brush_params make_brush_params(flo::paint_mode mode) {
+        return {
+            .radius = k_radius,
+            .mix = true,
+            .mode = mode,
+            .aa_level = 4,
+            .paint_transfer_coeff = 0.6
+        };
+    }
+
+    // a canvas with paint scattered over roughly half of it.
+    std::shared_ptr<flo::canvas> painted_canvas() {
+        auto canv = std::make_shared<flo::canvas>(k_palette, k_dim);
+        auto locs = random_locs(k_dim);
+        for (auto [i, loc] : locs | std::views::enumerate | std::views::take(k_num_locs / 2)) {
+            auto paint = flo::make_one_color_paint(
+                canv->palette_size(), static_cast<int>(i) % canv->palette_size(), 1.0
+            );
+            flo::fill(*canv, loc, k_radius, 4, paint);
+        }
+        return canv;
+    }
+
+    flo::bench::body brush_apply(flo::paint_mode mode,
+            std::shared_ptr<flo::canvas> canv = std::make_shared<flo::canvas>(k_palette, k_dim)) {
+        auto locs = random_locs(k_dim);
+        auto br = std::make_shared<flo::brush>(
+            make_brush_params(mode), flo::make_one_color_paint(canv->palette_size(), 2, 1.0)
+        );
+        size_t next = 0;
+        return [=]() mutable {
+            br->apply(*canv, locs[next], { 1.0, 100.0 });
+            next = (next + 1) % locs.size();
+        };
+    }
+
+    flo::bench::body region(int aa_level) {
+        flo::point loc = { 100.37, 200.81 };
+        return [=]() {
+            auto pixels = flo::detail::brush_region_aux(loc, k_radius, aa_level);
+            flo::bench::do_not_optimize(pixels);
+        };
+    }
+
+    std::vector<flo::point_mass> random_masses(const flo::dimensions& dim) {
+        std::vector<flo::point_mass> masses;
+        flo::rng_stream rng(2);
+        for (const auto& loc : random_locs(dim) | std::views::take(k_num_masses)) {
+            masses.push_back({ rng.uniform(0.5, 2.0), loc });
+        }
+        return masses;
+    }
+
+    template<typename F>
+    flo::bench::body generator(F make_field) {
+        return [=]() {
+            auto field = make_field();
+            flo::bench::do_not_optimize(field);
+        };
+    }
+
+}
+
+FLO_BENCHMARK("footprint/brush_region_aux/aa_0") {
+    return region(0);
+}
+
+FLO_BENCHMARK("footprint/brush_region_aux/aa_4") {
+    return region(4);
+}
+
+FLO_BENCHMARK("footprint/brush_region_aux/analytic") {
+    return region(flo::k_analytic_aa_level);
+}
+
+FLO_BENCHMARK("brush/apply/overlay") {
+    return brush_apply(flo::paint_mode::overlay);
+}
+
+FLO_BENCHMARK("brush/apply/fill") {
+    return brush_apply(flo::paint_mode::fill);
+}
+
+FLO_BENCHMARK("brush/apply/mix") {
+    return brush_apply(flo::paint_mode::mix);
+}
+
+// a paged canvas holding an eighth of its tiles in memory, with dabs scattered at random
+// so that most tiles are paged in.
+FLO_BENCHMARK("brush/apply/fill/paged") {
+    auto backing = std::filesystem::temp_directory_path() / "flowbee_bench.tiles";
+    return brush_apply(flo::paint_mode::fill,
+        std::make_shared<flo::canvas>(k_palette, k_dim, flo::paging_params{ backing.string(), 1.0 })
+    );
+}
+
+FLO_BENCHMARK("diffusion/apply") {
+    auto canv = painted_canvas();
+    auto engine = std::make_shared<flo::diffusion_engine>();
+    auto pool = std::make_shared<flo::thread_pool>(1);
+    return [=]() {
+        engine->apply(*canv, 0.05, *pool);
+    };
+}
+
+FLO_BENCHMARK("export/canvas_to_image") {
+    auto canv = painted_canvas();
+    return [=]() {
+        auto img = flo::canvas_to_image(*canv, 1.0);
+        flo::bench::do_not_optimize(img);
+    };
+}
+
+FLO_BENCHMARK("export/encode_png/fastest") {
+    auto img = std::make_shared<flo::image>(flo::canvas_to_image(*painted_canvas(), 1.0));
+    return [=]() {
+        auto png = flo::encode_png(*img, 1);
+        flo::bench::do_not_optimize(png);
+    };
+}
+
+FLO_BENCHMARK("export/encode_png/default") {
+    auto img = std::make_shared<flo::image>(flo::canvas_to_image(*painted_canvas(), 1.0));
+    return [=]() {
+        auto png = flo::encode_png(*img);
+        flo::bench::do_not_optimize(png);
+    };
+}
+
+FLO_BENCHMARK("export/encode_qoi") {
+    auto img = std::make_shared<flo::image>(flo::canvas_to_image(*painted_canvas(), 1.0));
+    return [=]() {
+        auto qoi = flo::encode_qoi(*img);
+        flo::bench::do_not_optimize(qoi);
+    };
+}
+
+FLO_BENCHMARK("vector_field/vector_from_field") {
+    auto field = std::make_shared<flo::vector_field>(
+        flo::circular_vector_field(k_dim, flo::circle_field_type::clockwise)
+    );
+    auto locs = random_locs(k_dim);
+    return [=]() {
+        flo::point sum = { 0.0, 0.0 };
+        for (const auto& loc : locs) {
+            sum = sum + flo::vector_from_field(*field, loc);
+        }
+        flo::bench::do_not_optimize(sum);
+    };
+}
+
+FLO_BENCHMARK("vector_field/perlin") {
+    return generator([]() { return flo::perlin_vector_field(k_dim, 8, 8.0, true); });
+}
+
+FLO_BENCHMARK("vector_field/perlin/all_threads") {
+    return generator([]() {
+        return flo::evaluate(k_dim, flo::perlin_field_rows(k_dim, 8, 8.0, true), 0);
+    });
+}
+
+FLO_BENCHMARK("vector_field/circular") {
+    return generator([]() {
+        return flo::circular_vector_field(k_dim, flo::circle_field_type::clockwise);
+    });
+}
+
+FLO_BENCHMARK("vector_field/elliptic") {
+    return generator([]() {
+        return flo::elliptic_vector_field(k_dim, flo::circle_field_type::clockwise);
+    });
+}
+
+FLO_BENCHMARK("vector_field/loxo_spiral") {
+    return generator([]() {
+        return flo::loxodromic_spiral_vector_field(k_dim, true, 160.0, 4.0);
+    });
+}
+
+FLO_BENCHMARK("vector_field/log_spiral") {
+    return generator([]() {
+        return flo::logarithmic_spiral_vector_field(k_dim, 2.0, false, true);
+    });
+}
+
+FLO_BENCHMARK("vector_field/zigzag") {
+    return generator([]() { return flo::zigzag_vector_field(k_dim, 50.0); });
+}
+
+FLO_BENCHMARK("vector_field/gravity") {
+    return generator([]() {
+        std::vector<flo::point_mass> masses = {
+            { 1.0, { 256.0, 512.0 } }, { 1.0, { 34.3, 128.0 } }, { 1.0, { 477.7, 128.0 } }
+        };
+        return flo::gravity(k_dim, masses);
+    });
+}
+
+FLO_BENCHMARK("vector_field/gravity/many_masses") {
+    return generator([]() { return flo::gravity(k_dim, random_masses(k_dim)); });
+}
+
+FLO_BENCHMARK("vector_field/gravity/many_masses/barnes_hut") {
+    return generator([]() { return flo::gravity(k_dim, random_masses(k_dim), 1.0, true, 0.5); });
+}
+
+FLO_BENCHMARK("vector_field/gradient") {
+    auto noise = std::make_shared<flo::scalar_field>(flo::white_noise(k_canvas_sz, k_canvas_sz));
+    return generator([=]() { return flo::gradient(*noise, 5, false); });
+}
+
+FLO_BENCHMARK("vector_field/gradient/large_kernel") {
+    auto noise = std::make_shared<flo::scalar_field>(flo::white_noise(k_canvas_sz, k_canvas_sz));
+    return generator([=]() { return flo::gradient(*noise, 151, false); });
+}
@@ -0,0 +1,99 @@
+#include "bench.hpp"
+#include "flowbee.hpp"
+#include "input.hpp"
+#include "util.hpp"
+#include "third-party/json.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    // scales the lengths in a field definition that are measured in pixels.
+    void scale_field_def(json& def, double scale) {
+        if (def.is_object()) {
+            for (auto& [key, value] : def.items()) {
+                if (key == "dimensions" || key == "loc") {
+                    for (auto& coord : value) {
+                        coord = coord.get<double>() * scale;
+                    }
+                    if (key == "dimensions") {
+                        value = {
+                            std::max(value[0].get<int>(), 1), std::max(value[1].get<int>(), 1)
+                        };
+                    }
+                } else if (key == "centers_dist" || key == "radius") {
+                    value = value.get<double>() * scale;
+                } else {
+                    scale_field_def(value, scale);
+                }
+            }
+        } else if (def.is_array()) {
+            for (auto& item : def) {
+                scale_field_def(item, scale);
+            }
+        }
+    }
+
+    // an example scene resized by options::scene_scale that runs for a fixed number of
+    // iterations, so that the timings of different scenes and sizes are comparable.
+    flo::input scaled_scene(const std::string& name) {
+        const auto& opts = flo::bench::current_options();
+        auto src = fs::path(opts.scene_dir) / (name + ".json");
+        std::ifstream in(src);
+        if (!in) {
+            throw std::runtime_error("unable to read " + src.string());
+        }
+        json j = json::parse(in);
+        j["rand_seed"] = 1;
+        for (auto& layer : j["layers"]) {
+            scale_field_def(layer["flow"], opts.scene_scale);
+            auto& params = layer["params"];
+            params["termination_criterion"] = opts.scene_iterations;
+            auto& radius = params["brush"]["radius"];
+            radius = std::max(radius.get<double>() * opts.scene_scale, 1.0);
+        }
+
+        auto scaled = fs::temp_directory_path() / ("flowbee_bench_" + name + ".json");
+        std::ofstream(scaled) << j.dump();
+        auto output = fs::temp_directory_path() / ("flowbee_bench_" + name + ".png");
+        auto input = flo::parse_input(scaled.string(), output.string());
+        fs::remove(scaled);
+        if (!input) {
+            throw std::runtime_error(input.error());
+        }
+        return *input;
+    }
+
+    flo::bench::body scene(const std::string& name) {
+        auto input = std::make_shared<flo::input>(scaled_scene(name));
+        return [=]() {
+            flo::set_rand_seed(1);
+            flo::do_flowbee(input->output, input->palette, input->layers);
+        };
+    }
+
+}
+
+FLO_BENCHMARK("scene/flow") {
+    return scene("flow");
+}
+
+FLO_BENCHMARK("scene/gravity") {
+    return scene("gravity");
+}
+
+FLO_BENCHMARK("scene/perturbed_circular") {
+    return scene("perturbed_circular");
+}
+
+FLO_BENCHMARK("scene/perturbed_spiral") {
+    return scene("perturbed_spiral");
+}
@@ -1,10 +1,13 @@
 #include "brush.hpp"
 #include "canvas.hpp"
 #include "types.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <print>
 #include <ranges>
-#include <unordered_map>
-#include <boost/functional/hash.hpp>
 
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
@@ -13,8 +16,6 @@ namespace rv = std::ranges::views;
 
 namespace {
 
-    constexpr double k_fixed_point_scale = 10000.0;
-
     double current_radius(double elapsed, double base_radius, std::optional<double> ramp_in_time,
             std::optional<double> stroke_lifespan, std::optional<double> ramp_out_time) {
         double in_radius = base_radius;
@@ -33,26 +34,118 @@ namespace {
         }
         return std::min(in_radius, out_radius);
     }
-}
 
-flo::detail::memo_key::memo_key(flo::point loc, double radius, int aa) {
-    x = static_cast<int>(std::round(loc.x * k_fixed_point_scale));
-    y = static_cast<int>(std::round(loc.y * k_fixed_point_scale));
-    r = static_cast<int>(std::round(radius * k_fixed_point_scale));
-    aa_level = aa;
-}
+    // coverage weights below this are rounding noise from differencing cumulative areas.
+    constexpr double k_min_coverage = 1e-12;
+
+    // the line v = h cutting a circle of radius r centered at the origin, where h >= 0.
+    // half_width is where the line meets the circle, zero if it misses.
+    struct chord {
+        double h;
+        double half_width;
+        double left_integral;
+    };
+
+    // antiderivative with respect to u of the height of the circle's upper boundary above
+    // the line v = h, evaluated in each lane of u.
+    template<typename L>
+    typename L::reg chord_integral(typename L::reg u, double h, double r) {
+        auto r_squared = L::splat(r * r);
+        auto height = L::sqrt(L::max(L::sub(r_squared, L::mul(u, u)), L::splat(0.0)));
+        auto angle = flo::simd::asin<L>(
+            L::min(L::max(L::div(u, L::splat(r)), L::splat(-1.0)), L::splat(1.0))
+        );
+        return L::sub(
+            L::mul(L::splat(0.5), L::add(L::mul(u, height), L::mul(r_squared, angle))),
+            L::mul(L::splat(h), u)
+        );
+    }
+
+    chord make_chord(double h, double r) {
+        double half_width = (h < r) ? std::sqrt(r * r - h * h) : 0.0;
+        return {
+            h, half_width,
+            chord_integral<flo::simd::detail::scalar<double>>(-half_width, h, r)
+        };
+    }
+
+    struct strip_term {
+        chord c;
+        double sign;
+    };
 
-bool flo::detail::memo_key::operator==(const flo::detail::memo_key& other) const {
-    return x == other.x && y == other.y && r == other.r && aa_level == other.aa_level;
+    struct strip {
+        std::array<strip_term, 3> terms;
+        int count;
+    };
+
+    // the area of the circle within y0 <= v <= y1 as a signed sum of areas above chords.
+    // Chords must lie in the upper half of the circle, so strips straddling v = 0 are
+    // split there and the lower half is mirrored.
+    strip strip_terms(double y0, double y1, double r) {
+        if (y0 >= 0.0) {
+            return { { { {make_chord(y0, r), 1.0}, {make_chord(y1, r), -1.0} } }, 2 };
+        }
+        if (y1 <= 0.0) {
+            return { { { {make_chord(-y1, r), 1.0}, {make_chord(-y0, r), -1.0} } }, 2 };
+        }
+        return {
+            { {
+                {make_chord(0.0, r), 2.0}, {make_chord(y1, r), -1.0}, {make_chord(-y0, r), -1.0}
+            } },
+            3
+        };
+    }
 }
 
-size_t flo::detail::memo_key_hash::operator()(const  flo::detail::memo_key & key) const {
-    size_t seed = 0;
-    boost::hash_combine(seed, key.x);
-    boost::hash_combine(seed, key.y);
-    boost::hash_combine(seed, key.r);
-    boost::hash_combine(seed, key.aa_level);
-    return seed;
+std::vector<flo::region_pixel> flo::detail::analytic_brush_region(
+        const flo::point& brush_loc,
+        double brush_radius) {
+
+    if (brush_radius <= 0.0) {
+        return {};
+    }
+
+    int min_x = static_cast<int>(std::floor(brush_loc.x - brush_radius));
+    int max_x = static_cast<int>(std::ceil(brush_loc.x + brush_radius));
+    int min_y = static_cast<int>(std::floor(brush_loc.y - brush_radius));
+    int max_y = static_cast<int>(std::ceil(brush_loc.y + brush_radius));
+
+    // each row's coverage is the difference of the cumulative area left of consecutive
+    // pixel edges, computed across the row a register of edges at a time before any
+    // weights are emitted.
+    int num_edges = max_x - min_x + 2;
+    std::vector<double> edges(num_edges);
+    for (int i = 0; i < num_edges; ++i) {
+        edges[i] = min_x + i - brush_loc.x;
+    }
+    std::vector<double> cumulative(num_edges);
+    std::vector<flo::region_pixel> region;
+    for (int y = min_y; y <= max_y; ++y) {
+        auto strip = strip_terms(y - brush_loc.y, y + 1 - brush_loc.y, brush_radius);
+        flo::simd::for_each_lane<double>(num_edges,
+            [&](auto lanes, int i) {
+                using l = decltype(lanes);
+                auto edge = l::load(edges.data() + i);
+                auto area = l::splat(0.0);
+                for (const auto& [c, sign] : strip.terms | rv::take(strip.count)) {
+                    auto u = l::min(l::max(edge, l::splat(-c.half_width)), l::splat(c.half_width));
+                    auto above = l::sub(
+                        chord_integral<l>(u, c.h, brush_radius), l::splat(c.left_integral)
+                    );
+                    area = l::add(area, l::mul(l::splat(sign), above));
+                }
+                l::store(cumulative.data() + i, area);
+            }
+        );
+        for (int i = 0; i + 1 < num_edges; ++i) {
+            double weight = std::clamp(cumulative[i + 1] - cumulative[i], 0.0, 1.0);
+            if (weight > k_min_coverage) {
+                region.push_back({ {min_x + i, y}, weight });
+            }
+        }
+    }
+    return region;
 }
 
 std::vector<flo::region_pixel> flo::detail::brush_region_aux(
@@ -60,6 +153,10 @@ std::vector<flo::region_pixel> flo::detail::brush_region_aux(
         double brush_radius,
         int anti_aliasing_level) {
 
+    if (anti_aliasing_level == k_analytic_aa_level) {
+        return analytic_brush_region(brush_loc, brush_radius);
+    }
+
     const int resolution = (1 << anti_aliasing_level); // 2^level subdivisions
     const double subcell_size = 1.0 / resolution;
     const double subcell_area = subcell_size * subcell_size;
@@ -108,49 +205,144 @@ std::vector<flo::region_pixel> flo::detail::brush_region_aux(
     ) | r::to<std::vector>();
 }
 
+flo::brush_dab::brush_dab(const dimensions& dim, const point& loc, double radius,
+        int aa_level) : bounds_(dim) {
+    point int_loc = { std::floor(loc.x), std::floor(loc.y) };
+    footprint_ = brush_footprints().get(loc - int_loc, radius, aa_level);
+    origin_ = to_coords(int_loc);
+}
+
+template<typename F>
+void flo::brush_dab::for_each_run(F&& f) const {
+    const double* weights = footprint_->weights.data();
+    for (const auto& run : footprint_->runs) {
+        int y = origin_.y + run.y;
+        if (y < 0 || y >= bounds_.hgt) {
+            continue;
+        }
+        int x_begin = origin_.x + run.x_begin;
+        int x_end = origin_.x + run.x_end;
+        int clipped_begin = std::max(x_begin, 0);
+        int clipped_end = std::min(x_end, bounds_.wd);
+        if (clipped_begin >= clipped_end) {
+            continue;
+        }
+        f(clipped_begin, y, weights + run.weights + (clipped_begin - x_begin),
+            clipped_end - clipped_begin);
+    }
+}
+
+template<typename F>
+void flo::brush_dab::for_each_cell_run(const canvas& canv, F&& f) const {
+    for_each_run(
+        [&](int x, int y, const double* weights, int n) {
+            // runs are split where the canvas storage changes stride, i.e. at tile edges.
+            for (int i = 0; i < n;) {
+                int len = std::min(n - i, canv.contiguous_cells(x + i));
+                f(x + i, y, weights + i, len);
+                i += len;
+            }
+        }
+    );
+}
+
+double flo::brush_dab::area() const {
+    double area = 0.0;
+    for_each_run(
+        [&](int, int, const double* weights, int n) {
+            for (int i = 0; i < n; ++i) {
+                area += weights[i];
+            }
+        }
+    );
+    return area;
+}
+
+flo::dab_sample flo::brush_dab::gather(const canvas& canv) const {
+    dab_sample sample{ 0.0, paint_mixture(canv.palette_size(), 0.0) };
+    for_each_cell_run(canv,
+        [&](int x, int y, const double* weights, int n) {
+            for (int i = 0; i < n; ++i) {
+                sample.area += weights[i];
+            }
+            add_scaled_run(sample.paint, canv.run(x, y, n), weights);
+        }
+    );
+    return sample;
+}
+
+void flo::brush_dab::fill(canvas& canv, const paint_mixture& paint) const {
+    for_each_cell_run(canv,
+        [&](int x, int y, const double* weights, int n) {
+            blend_run(canv.run(x, y, n), weights, paint);
+            canv.update_blank_state(x, y, n);
+            FLO_PROFILE_COUNT("pixels_painted", n);
+        }
+    );
+}
+
+void flo::brush_dab::overlay(canvas& canv, const paint_mixture& paint) const {
+    for_each_cell_run(canv,
+        [&](int x, int y, const double* weights, int n) {
+            add_scaled_run(canv.run(x, y, n), weights, paint);
+            canv.update_blank_state(x, y, n);
+            FLO_PROFILE_COUNT("pixels_painted", n);
+        }
+    );
+}
+
 flo::brush::brush(const brush_params& params, const paint_mixture& p) :
-        radius_(params.radius),
-        ramp_in_time_(params.radius_ramp_in_time),
-        mix_(params.mix),
-        mode_(params.mode),
-        aa_level_(params.aa_level),
-        paint_transfer_coeff_(params.paint_transfer_coeff),
+        params_(params),
         paint_(p),
         alive_(true) {
 
     if (params.stroke_lifetime) {
         lifespan_ = normal_rand(params.stroke_lifetime->mean, params.stroke_lifetime->stddev);
-        ramp_out_time_ = params.stroke_lifetime->ramp_out_time;
     }
 
 }
 
-void flo::brush::apply(canvas& canv, const point& loc, const elapsed_time& t) {
+void flo::apply_brush(canvas& canv, const brush_params& params, paint_mixture& paint,
+        const point& loc, double elapsed, std::optional<double> lifespan) {
+
+    auto ramp_out_time = params.stroke_lifetime ?
+        params.stroke_lifetime->ramp_out_time : std::nullopt;
+    double radius = current_radius(
+        elapsed, params.radius, params.radius_ramp_in_time, lifespan, ramp_out_time
+    );
 
-    double radius = current_radius( t.elapsed, radius_, ramp_in_time_, lifespan_, ramp_out_time_);
+    // one pass gathers the area and paint under the dab for both pickup and paint_mode::mix,
+    // which cannot change it before the deposit pass.
+    brush_dab dab(canv.bounds(), loc, radius, params.aa_level);
+    FLO_PROFILE_COUNT("brush_dabs", 1);
+    std::optional<dab_sample> sample;
+    if (params.mix || params.mode == paint_mode::mix) {
+        sample = dab.gather(canv);
+    }
 
-    if (mix_) {
-        auto brush_rgn_area =
-            brush_region_area(canv.bounds(), loc, radius, aa_level_);
-        auto paint_on_canvas =
-            all_paint_in_brush_region(canv, loc, radius, aa_level_);
-        normalize_in_place(paint_on_canvas);
+    if (params.mix) {
+        auto paint_on_canvas = normalize(sample->paint);
 
-        auto k = paint_transfer_coeff_;
+        auto k = params.paint_transfer_coeff;
         auto new_paint = (volume(paint_on_canvas) > 0.0) ?
-            (1.0 - k) * paint_on_canvas + k * paint_ :
-            paint_;
+            (1.0 - k) * paint_on_canvas + k * paint :
+            paint;
 
-        paint_ = new_paint;
+        paint = new_paint;
     }
 
-    if (mode_ == paint_mode::overlay) {
-        overlay(canv, loc, radius, aa_level_, paint_);
-    } else if (mode_ == paint_mode::fill) {
-        fill(canv, loc, radius, aa_level_, paint_);
+    if (params.mode == paint_mode::overlay) {
+        dab.overlay(canv, paint);
+    } else if (params.mode == paint_mode::fill) {
+        dab.fill(canv, paint);
     } else {
-        mix(canv, loc, radius, aa_level_);
+        dab.fill(canv, (1.0 / sample->area) * sample->paint);
     }
+}
+
+void flo::brush::apply(canvas& canv, const point& loc, const elapsed_time& t) {
+
+    apply_brush(canv, params_, paint_, loc, t.elapsed, lifespan_);
     
     if (lifespan_ && t.elapsed >= lifespan_) {
         alive_ = false;
@@ -170,5 +362,5 @@ void flo::brush::set_lifespan(double duration) {
 }
 
 void flo::brush::set_radius(double rad) {
-    radius_ = rad;
+    params_.radius = rad;
 }
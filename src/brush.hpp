@@ -4,8 +4,10 @@
 #include <ranges>
 #include <print>
 #include <optional>
+#include <span>
 #include "types.hpp"
 #include "canvas.hpp"
+#include "footprint_cache.hpp"
 #include "paint_mixture.hpp"
 #include "util.hpp"
 
@@ -13,29 +15,15 @@
 
 namespace flo {
 
-    struct region_pixel {
-        coords loc;
-        double weight;
-    };
+    // an aa_level that selects exact, analytically computed pixel coverage instead of
+    // supersampling.
+    constexpr int k_analytic_aa_level = -1;
 
     namespace detail {
 
-        struct memo_key {
-            int x;
-            int y;
-            int r;
-            int aa_level;
-
-            memo_key(flo::point loc, double radius, int aa);
-            bool operator==(const memo_key& other) const;
-        };
-
-        struct memo_key_hash {
-            size_t operator()(const memo_key& key) const;
-        };
-
-        using memoization_tbl =
-            std::unordered_map<memo_key, std::vector<flo::region_pixel>, memo_key_hash>;
+        std::vector<flo::region_pixel> analytic_brush_region(
+            const flo::point& brush_loc,
+            double brush_radius);
 
         std::vector<flo::region_pixel> brush_region_aux(
             const flo::point& brush_loc,
@@ -72,15 +60,45 @@ namespace flo {
     };
 
 
+    // the paint under a brush dab: the area it covers and the coverage-weighted sum of
+    // the paint in it.
+    struct dab_sample {
+        double area;
+        paint_mixture paint;
+    };
+
+    // the canvas pixels covered by one brush dab. The footprint is looked up once, so a
+    // brush can gather from and deposit to the same dab without repeating work. Passes
+    // walk the footprint's row runs, clipping each run to the canvas once, and hand the
+    // kernels contiguous runs of cells.
+    class brush_dab {
+        std::shared_ptr<const footprint> footprint_;
+        coords origin_;
+        dimensions bounds_;
+
+        template<typename F>
+        void for_each_run(F&& f) const;
+
+        template<typename F>
+        void for_each_cell_run(const canvas& canv, F&& f) const;
+
+    public:
+        brush_dab(const dimensions& dim, const point& loc, double radius, int aa_level);
+
+        double area() const;
+        dab_sample gather(const canvas& canv) const;
+        void fill(canvas& canv, const paint_mixture& paint) const;
+        void overlay(canvas& canv, const paint_mixture& paint) const;
+    };
+
+    // paints one dab of a brush described by params at loc. If the brush mixes, the
+    // paint it carries picks up paint from the canvas before it is deposited.
+    void apply_brush(canvas& canv, const brush_params& params, paint_mixture& paint,
+        const point& loc, double elapsed, std::optional<double> lifespan);
+
     class brush {
 
-        double radius_;
-        std::optional<double> ramp_in_time_;
-        std::optional<double> ramp_out_time_;
-        bool mix_;
-        paint_mode mode_;
-        int aa_level_;
-        double paint_transfer_coeff_;
+        brush_params params_;
         paint_mixture paint_;
         std::optional<double> lifespan_;
         bool alive_;
@@ -93,32 +111,4 @@ namespace flo {
         void set_lifespan(double duration);
         void set_radius(double rad);
     };
-
-    inline auto brush_region(const flo::dimensions& dim,
-            const flo::point& loc,
-            double brush_radius,
-            int aa_level) {
-
-        namespace r = std::ranges;
-        namespace rv = std::ranges::views;
-
-        static detail::memoization_tbl memos;
-        point int_loc = { std::floor(loc.x), std::floor(loc.y) };
-        point unit_square_loc = loc - int_loc;
-        auto key = detail::memo_key(int_loc, brush_radius, aa_level);
-
-        if (!memos.contains(key)) {
-            memos[key] = detail::brush_region_aux(unit_square_loc, brush_radius, aa_level);
-        }
-
-        return memos.at(key) | rv::transform(
-            [int_loc](auto&& rp)->flo::region_pixel {
-                return { to_coords(int_loc) + rp.loc, rp.weight };
-            }
-        ) | rv::filter(
-            [dim](const flo::region_pixel& rp) {
-                return in_bounds(rp.loc, dim);
-            }
-        );
-    }
 }
\ No newline at end of file
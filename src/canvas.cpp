@@ -1,12 +1,20 @@
 #include "canvas.hpp"
 #include "brush.hpp"
 #include "util.hpp"
+#include "thread_pool.hpp"
+#include "profiler.hpp"
 #include <ranges>
 #include <algorithm>
+#include <bit>
 #include <functional>
 #include <numeric>
+#include <optional>
+#include <format>
+#include <limits>
 #include <print>
+#include <stdexcept>
 #include <unordered_map>
+#include <utility>
 
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
@@ -14,6 +22,10 @@ namespace rv = std::ranges::views;
 /*------------------------------------------------------------------------------------------------*/
 
 namespace {
+
+    // the log of the blank_cell_set::deferral held by this thread, if any.
+    thread_local std::vector<int>* t_deferred_log = nullptr;
+
     flo::pigment to_pigment(const flo::rgb_color& col) {
         return rgb_to_pigment(col);
     }
@@ -42,6 +54,142 @@ namespace {
         );
     }
 
+    // converts canvas cells to pixels a batch at a time. The palette's latent vectors are
+    // merged and ordered as canvas::color_at's pigment_map merges and orders them, and
+    // mixed with the arithmetic of mix_paint and mix_pigments, so every pixel is exactly
+    // the one those functions would give without building a map per cell.
+    class pixel_exporter {
+        std::vector<flo::pigment> pigments_;
+        std::vector<int> layers_;
+        flo::pigment bkgd_;
+        double alpha_threshold_;
+
+    public:
+        pixel_exporter(const flo::canvas& canv, double alpha_threshold,
+                const flo::rgb_color& canvas_color) :
+                bkgd_(flo::rgb_to_pigment(canvas_color)),
+                alpha_threshold_(alpha_threshold) {
+            // a map from equal pigments keeps the first's latent vector and the last's volume.
+            flo::pigment_map<int> pigment_to_layer;
+            for (auto [i, pigment] : rv::enumerate(canv.palette())) {
+                pigment_to_layer[pigment] = static_cast<int>(i);
+            }
+            for (const auto& [pigment, layer] : pigment_to_layer) {
+                pigments_.push_back(pigment);
+                layers_.push_back(layer);
+            }
+        }
+
+        // the run must not be longer than the batch size.
+        void to_pixels(const flo::const_cell_run& run, uint32_t* pixels) const {
+            constexpr int k_latent = MIXBOX_LATENT_SIZE;
+            auto [cells, cell_stride, layer_stride, layers, n] = run;
+            flo::pigment_batch batch;
+            double total[flo::pigment_batch::k_size];
+            double volume[flo::pigment_batch::k_size];
+            for (int i = 0; i < k_latent; ++i) {
+                std::fill_n(batch.impl[i], n, 0.0f);
+            }
+            std::fill_n(total, n, 0.0);
+            std::fill_n(volume, n, 0.0);
+
+            for (auto [pigment, layer] : rv::zip(pigments_, layers_)) {
+                const flo::paint_value* vols = cells + layer * layer_stride;
+                for (int j = 0; j < n; ++j) {
+                    double vol = vols[j * cell_stride];
+                    for (int i = 0; i < k_latent; ++i) {
+                        batch.impl[i][j] += pigment.impl[i] * vol;
+                    }
+                    total[j] += vol;
+                }
+            }
+            for (int z = 0; z < layers; ++z) {
+                const flo::paint_value* vols = cells + z * layer_stride;
+                for (int j = 0; j < n; ++j) {
+                    volume[j] += vols[j * cell_stride];
+                }
+            }
+
+            for (int j = 0; j < n; ++j) {
+                if (total[j] > 0.0) {
+                    for (int i = 0; i < k_latent; ++i) {
+                        batch.impl[i][j] /= total[j];
+                    }
+                }
+                if (alpha_threshold_ > 0.0) {
+                    double alpha = (volume[j] >= alpha_threshold_) ?
+                        1.0 : volume[j] / alpha_threshold_;
+                    auto bkgd_weight = static_cast<float>(1.0 - alpha);
+                    auto paint_weight = static_cast<float>(alpha);
+                    auto scale = static_cast<float>(1.0 / ((1.0 - alpha) + alpha));
+                    for (int i = 0; i < k_latent; ++i) {
+                        batch.impl[i][j] = scale *
+                            (bkgd_weight * bkgd_.impl[i] + paint_weight * batch.impl[i][j]);
+                    }
+                }
+            }
+
+            flo::rgb_color colors[flo::pigment_batch::k_size];
+            flo::pigments_to_rgb(batch, n, colors);
+            for (int j = 0; j < n; ++j) {
+                pixels[j] = flo::rgb_to_pixel(colors[j]);
+            }
+        }
+    };
+
+    const flo::canvas& unpaged(const flo::canvas& canv) {
+        if (canv.is_paged()) {
+            throw std::logic_error("a paged canvas cannot be copied");
+        }
+        return canv;
+    }
+
+    // a paged canvas is exported tile by tile in batches of no more tiles than it keeps in
+    // memory. The rows of a batch's tiles are looked up, paging the tiles in, before they
+    // are converted in parallel, so no tile is paged out while it is being read.
+    template<typename F>
+    void export_paged_tiles(const flo::canvas& canv, const pixel_exporter& exporter,
+            std::optional<uint32_t> blank_pixel, int batch_size, flo::thread_pool& pool,
+            F pixels_at) {
+        static_assert(flo::pigment_batch::k_size >= flo::tile_store::k_tile_size);
+        struct tile_row {
+            flo::coords loc;
+            flo::const_cell_run cells;
+        };
+        std::vector<tile_row> batch;
+        int batch_tiles = 0;
+        auto convert_batch = [&]() {
+            pool.parallel_for(static_cast<int>(batch.size()),
+                [&](int i) {
+                    exporter.to_pixels(batch[i].cells, pixels_at(batch[i].loc.x, batch[i].loc.y));
+                }
+            );
+            batch.clear();
+            batch_tiles = 0;
+        };
+
+        const auto& tiles = canv.tiles();
+        for (int tile_y = 0; tile_y < tiles.rows(); ++tile_y) {
+            for (int tile_x = 0; tile_x < tiles.cols(); ++tile_x) {
+                auto [min, max] = tiles.tile_bounds(tile_x, tile_y, canv.bounds());
+                if (!tiles.is_painted(tile_x, tile_y)) {
+                    for (int y = min.y; y <= max.y; ++y) {
+                        std::fill(pixels_at(min.x, y), pixels_at(max.x + 1, y), *blank_pixel);
+                    }
+                    continue;
+                }
+                if (batch_tiles == batch_size) {
+                    convert_batch();
+                }
+                for (int y = min.y; y <= max.y; ++y) {
+                    batch.push_back({ { min.x, y }, canv.run(min.x, y, max.x + 1 - min.x) });
+                }
+                ++batch_tiles;
+            }
+        }
+        convert_batch();
+    }
+
     int find_closest_color(
             const flo::rgb_color& color, const std::vector<flo::rgb_color>& palette) {
         int closest = -1;
@@ -57,21 +205,429 @@ namespace {
     }
 }
 
-flo::canvas::canvas(const std::vector<rgb_color>& palette, int wd, int hgt) :
+flo::blank_cell_set::blank_cell_set(int num_cells) :
+    cells_(rv::iota(0, num_cells) | r::to<std::vector>()),
+    slots_(cells_),
+    blank_(num_cells, 1)
+{
+}
+
+flo::blank_cell_set::blank_cell_set(const blank_cell_set& other) :
+    cells_(other.cells_),
+    slots_(other.slots_),
+    blank_(other.blank_)
+{
+}
+
+flo::blank_cell_set::blank_cell_set(blank_cell_set&& other) noexcept :
+    cells_(std::move(other.cells_)),
+    slots_(std::move(other.slots_)),
+    blank_(std::move(other.blank_))
+{
+}
+
+flo::blank_cell_set& flo::blank_cell_set::operator=(const blank_cell_set& other) {
+    cells_ = other.cells_;
+    slots_ = other.slots_;
+    blank_ = other.blank_;
+    return *this;
+}
+
+flo::blank_cell_set& flo::blank_cell_set::operator=(blank_cell_set&& other) noexcept {
+    cells_ = std::move(other.cells_);
+    slots_ = std::move(other.slots_);
+    blank_ = std::move(other.blank_);
+    return *this;
+}
+
+flo::blank_cell_set::deferral::deferral(std::vector<int>& log) :
+    previous_(t_deferred_log)
+{
+    t_deferred_log = &log;
+}
+
+flo::blank_cell_set::deferral::~deferral() {
+    t_deferred_log = previous_;
+}
+
+void flo::blank_cell_set::update(int cell, bool blank) {
+    // only the thread painting a cell reads or writes its flag, so the lock is needed
+    // only for the rare updates that change membership.
+    if (static_cast<bool>(blank_[cell]) == blank) {
+        return;
+    }
+    blank_[cell] = blank;
+    if (t_deferred_log) {
+        t_deferred_log->push_back(cell);
+        return;
+    }
+    std::lock_guard lock(mutex_);
+    sync_membership(cell);
+}
+
+void flo::blank_cell_set::apply(std::span<const int> log) {
+    std::lock_guard lock(mutex_);
+    for (int cell : log) {
+        sync_membership(cell);
+    }
+}
+
+void flo::blank_cell_set::sync_membership(int cell) {
+    bool member = slots_[cell] >= 0;
+    if (blank_[cell] && !member) {
+        slots_[cell] = static_cast<int>(cells_.size());
+        cells_.push_back(cell);
+    } else if (!blank_[cell] && member) {
+        int slot = slots_[cell];
+        int last = cells_.back();
+        cells_[slot] = last;
+        slots_[last] = slot;
+        cells_.pop_back();
+        slots_[cell] = -1;
+    }
+}
+
+bool flo::blank_cell_set::contains(int cell) const {
+    return blank_[cell];
+}
+
+int flo::blank_cell_set::size() const {
+    return static_cast<int>(cells_.size());
+}
+
+int flo::blank_cell_set::operator[](int i) const {
+    return cells_[i];
+}
+
+std::span<const int> flo::blank_cell_set::cells() const {
+    return cells_;
+}
+
+void flo::blank_cell_set::assign(std::span<const int> cells) {
+    std::lock_guard lock(mutex_);
+    cells_.assign(cells.begin(), cells.end());
+    r::fill(slots_, -1);
+    r::fill(blank_, 0);
+    for (auto [slot, cell] : rv::enumerate(cells_)) {
+        if (cell < 0 || cell >= static_cast<int>(slots_.size()) || blank_[cell]) {
+            throw std::invalid_argument("blank_cell_set::assign: invalid cell");
+        }
+        slots_[cell] = static_cast<int>(slot);
+        blank_[cell] = 1;
+    }
+}
+
+flo::dirty_tiles::dirty_tiles(const dimensions& canvas_dim) :
+    cols_((canvas_dim.wd + k_tile_size - 1) / k_tile_size),
+    rows_((canvas_dim.hgt + k_tile_size - 1) / k_tile_size),
+    flags_(cols_ * rows_, 0)
+{
+}
+
+void flo::dirty_tiles::mark(int x_begin, int x_end, int y, uint8_t flags) {
+    int row = (y / k_tile_size) * cols_;
+    for (int tile_x = x_begin / k_tile_size; tile_x <= (x_end - 1) / k_tile_size; ++tile_x) {
+        // once a tile is flagged the common case is a relaxed load.
+        std::atomic_ref<uint8_t> tile(flags_[row + tile_x]);
+        if ((tile.load(std::memory_order_relaxed) & flags) != flags) {
+            tile.fetch_or(flags, std::memory_order_relaxed);
+        }
+    }
+}
+
+void flo::dirty_tiles::clear(uint8_t flags) {
+    for (auto& tile : flags_) {
+        tile &= ~flags;
+    }
+}
+
+int flo::dirty_tiles::cols() const {
+    return cols_;
+}
+
+int flo::dirty_tiles::rows() const {
+    return rows_;
+}
+
+bool flo::dirty_tiles::is_painted(int tile_x, int tile_y) const {
+    return flags_[tile_y * cols_ + tile_x] & k_painted;
+}
+
+bool flo::dirty_tiles::is_changed(int tile_x, int tile_y) const {
+    return flags_[tile_y * cols_ + tile_x] & k_changed;
+}
+
+std::span<const uint8_t> flo::dirty_tiles::flags() const {
+    return flags_;
+}
+
+void flo::dirty_tiles::assign(std::span<const uint8_t> flags) {
+    if (flags.size() != flags_.size()) {
+        throw std::invalid_argument("dirty_tiles::assign: wrong number of tiles");
+    }
+    r::copy(flags, flags_.begin());
+}
+
+void flo::dirty_tiles::copy_tile(const dirty_tiles& source, int tile_x, int tile_y) {
+    flags_[tile_y * cols_ + tile_x] = source.flags_[tile_y * cols_ + tile_x];
+}
+
+bool flo::dirty_tiles::any_painted() const {
+    return r::any_of(flags_, [](uint8_t tile) { return tile & k_painted; });
+}
+
+flo::rect flo::dirty_tiles::tile_bounds(
+        int tile_x, int tile_y, const dimensions& canvas_dim) const {
+    return {
+        { tile_x * k_tile_size, tile_y * k_tile_size },
+        {
+            std::min((tile_x + 1) * k_tile_size, canvas_dim.wd) - 1,
+            std::min((tile_y + 1) * k_tile_size, canvas_dim.hgt) - 1
+        }
+    };
+}
+
+flo::tiled_blank_cell_set::tiled_blank_cell_set(const dimensions& canvas_dim) :
+    cols_(canvas_dim.wd),
+    rows_(canvas_dim.hgt),
+    tiles_x_((canvas_dim.wd + k_tile_size - 1) / k_tile_size),
+    size_(0),
+    counts_(tiles_x_ * ((canvas_dim.hgt + k_tile_size - 1) / k_tile_size)),
+    lists_(counts_.size())
+{
+    for (int tile = 0; tile < static_cast<int>(counts_.size()); ++tile) {
+        auto [wd, hgt] = tile_dimensions(tile);
+        counts_[tile] = wd * hgt;
+    }
+    rebuild_sums();
+}
+
+flo::dimensions flo::tiled_blank_cell_set::tile_dimensions(int tile) const {
+    int x = (tile % tiles_x_) * k_tile_size;
+    int y = (tile / tiles_x_) * k_tile_size;
+    return { std::min(k_tile_size, cols_ - x), std::min(k_tile_size, rows_ - y) };
+}
+
+void flo::tiled_blank_cell_set::add_to_count(int tile, int delta) {
+    counts_[tile] += delta;
+    size_ += delta;
+    for (int i = tile + 1; i < static_cast<int>(sums_.size()); i += i & -i) {
+        sums_[i] += delta;
+    }
+}
+
+void flo::tiled_blank_cell_set::rebuild_sums() {
+    // sums_ is a Fenwick tree over counts_, one-based.
+    sums_.assign(counts_.size() + 1, 0);
+    size_ = 0;
+    for (int i = 1; i < static_cast<int>(sums_.size()); ++i) {
+        sums_[i] += counts_[i - 1];
+        size_ += counts_[i - 1];
+        int parent = i + (i & -i);
+        if (parent < static_cast<int>(sums_.size())) {
+            sums_[parent] += sums_[i];
+        }
+    }
+}
+
+flo::tiled_blank_cell_set::tile_cells& flo::tiled_blank_cell_set::cells_of(int tile) {
+    auto& list = lists_[tile];
+    if (!list) {
+        // a tile without a list has either all of its cells, in row-major order, or none.
+        auto [wd, hgt] = tile_dimensions(tile);
+        list = std::make_unique<tile_cells>();
+        list->slots.assign(wd * hgt, k_no_slot);
+        if (counts_[tile] > 0) {
+            for (int i = 0; i < wd * hgt; ++i) {
+                list->cells.push_back(static_cast<uint16_t>(i));
+                list->slots[i] = static_cast<uint16_t>(i);
+            }
+        }
+    }
+    return *list;
+}
+
+void flo::tiled_blank_cell_set::update(int cell, bool blank) {
+    int x = cell % cols_;
+    int y = cell / cols_;
+    int tile = (y / k_tile_size) * tiles_x_ + x / k_tile_size;
+    int local = (y % k_tile_size) * tile_dimensions(tile).wd + x % k_tile_size;
+    if (contains(cell) == blank) {
+        return;
+    }
+    auto& list = cells_of(tile);
+    if (blank) {
+        list.slots[local] = static_cast<uint16_t>(list.cells.size());
+        list.cells.push_back(static_cast<uint16_t>(local));
+        add_to_count(tile, 1);
+        return;
+    }
+    auto slot = list.slots[local];
+    auto last = list.cells.back();
+    list.cells[slot] = last;
+    list.slots[last] = slot;
+    list.cells.pop_back();
+    list.slots[local] = k_no_slot;
+    add_to_count(tile, -1);
+    if (counts_[tile] == 0) {
+        lists_[tile].reset();
+    }
+}
+
+bool flo::tiled_blank_cell_set::contains(int cell) const {
+    int x = cell % cols_;
+    int y = cell / cols_;
+    int tile = (y / k_tile_size) * tiles_x_ + x / k_tile_size;
+    if (!lists_[tile]) {
+        return counts_[tile] > 0;
+    }
+    int local = (y % k_tile_size) * tile_dimensions(tile).wd + x % k_tile_size;
+    return lists_[tile]->slots[local] != k_no_slot;
+}
+
+int flo::tiled_blank_cell_set::size() const {
+    return size_;
+}
+
+int flo::tiled_blank_cell_set::operator[](int i) const {
+    // descends the tree for the last tile whose preceding tiles hold no more than i cells.
+    int tile = 0;
+    int num_tiles = static_cast<int>(counts_.size());
+    for (int step = std::bit_floor(static_cast<unsigned>(num_tiles)); step > 0; step /= 2) {
+        if (tile + step <= num_tiles && sums_[tile + step] <= i) {
+            tile += step;
+            i -= sums_[tile];
+        }
+    }
+    int local = lists_[tile] ? lists_[tile]->cells[i] : i;
+    int wd = tile_dimensions(tile).wd;
+    int x = (tile % tiles_x_) * k_tile_size + local % wd;
+    int y = (tile / tiles_x_) * k_tile_size + local / wd;
+    return y * cols_ + x;
+}
+
+std::span<const int> flo::tiled_blank_cell_set::cells() const {
+    order_.clear();
+    for (int tile = 0; tile < static_cast<int>(lists_.size()); ++tile) {
+        if (!lists_[tile]) {
+            if (counts_[tile] > 0) {
+                order_.push_back(-tile - 1);
+            }
+            continue;
+        }
+        int wd = tile_dimensions(tile).wd;
+        int x = (tile % tiles_x_) * k_tile_size;
+        int y = (tile / tiles_x_) * k_tile_size;
+        for (int local : lists_[tile]->cells) {
+            order_.push_back((y + local / wd) * cols_ + x + local % wd);
+        }
+    }
+    return order_;
+}
+
+void flo::tiled_blank_cell_set::assign(std::span<const int> cells) {
+    auto invalid = []() {
+        return std::invalid_argument("tiled_blank_cell_set::assign: invalid cell");
+    };
+    r::fill(counts_, 0);
+    for (auto& list : lists_) {
+        list.reset();
+    }
+    for (int cell : cells) {
+        if (cell < 0) {
+            int tile = -cell - 1;
+            if (tile >= static_cast<int>(counts_.size()) || lists_[tile] || counts_[tile]) {
+                throw invalid();
+            }
+            auto [wd, hgt] = tile_dimensions(tile);
+            counts_[tile] = wd * hgt;
+            continue;
+        }
+        if (cell >= cols_ * rows_) {
+            throw invalid();
+        }
+        int x = cell % cols_;
+        int y = cell / cols_;
+        int tile = (y / k_tile_size) * tiles_x_ + x / k_tile_size;
+        int local = (y % k_tile_size) * tile_dimensions(tile).wd + x % k_tile_size;
+        if (!lists_[tile] && counts_[tile]) {
+            throw invalid();
+        }
+        auto& list = cells_of(tile);
+        if (list.slots[local] != k_no_slot) {
+            throw invalid();
+        }
+        list.slots[local] = static_cast<uint16_t>(list.cells.size());
+        list.cells.push_back(static_cast<uint16_t>(local));
+        ++counts_[tile];
+    }
+    rebuild_sums();
+}
+
+flo::canvas::canvas(const std::vector<rgb_color>& palette, int wd, int hgt,
+        storage_layout layout) :
     palette_{
         palette | rv::transform( to_pigment ) | r::to<std::vector>()
     },
     impl_{
-        wd, hgt, static_cast<int>(palette.size()), 0.0
+        wd, hgt, static_cast<int>(palette.size()), 0.0, layout
+    },
+    blank_cells_{
+        wd * hgt
+    },
+    dirty_tiles_{
+        { wd, hgt }
     }
 {
+    if (palette_.size() > k_max_palette_size) {
+        throw std::invalid_argument(
+            std::format("palettes are limited to {} colors", k_max_palette_size)
+        );
+    }
 }
 
-flo::canvas::canvas(const std::vector<rgb_color>& palette, const dimensions& dim) :
-    canvas(palette, dim.wd, dim.hgt)
+flo::canvas::canvas(const std::vector<rgb_color>& palette, const dimensions& dim,
+        storage_layout layout) :
+    canvas(palette, dim.wd, dim.hgt, layout)
 {
 }
 
+flo::canvas::canvas(const std::vector<rgb_color>& palette, const dimensions& dim,
+        const paging_params& paging) :
+    palette_{
+        palette | rv::transform( to_pigment ) | r::to<std::vector>()
+    },
+    dirty_tiles_{
+        dim
+    }
+{
+    if (palette_.size() > k_max_palette_size) {
+        throw std::invalid_argument(
+            std::format("palettes are limited to {} colors", k_max_palette_size)
+        );
+    }
+    store_ = std::make_unique<tile_store>(dim.wd, dim.hgt, palette_size(), paging);
+    tiled_blank_cells_ = std::make_unique<tiled_blank_cell_set>(dim);
+}
+
+flo::canvas::canvas(const canvas& other) :
+    palette_(unpaged(other).palette_),
+    impl_(other.impl_),
+    blank_cells_(other.blank_cells_),
+    dirty_tiles_(other.dirty_tiles_)
+{
+}
+
+flo::canvas& flo::canvas::operator=(const canvas& other) {
+    palette_ = unpaged(other).palette_;
+    impl_ = other.impl_;
+    store_.reset();
+    blank_cells_ = other.blank_cells_;
+    tiled_blank_cells_.reset();
+    dirty_tiles_ = other.dirty_tiles_;
+    return *this;
+}
+
 flo::canvas::canvas( const std::vector<rgb_color>& palette, int wd, int hgt, int bkgd, double amnt) :
         canvas(palette, wd, hgt) {
     for (int y = 0; y < hgt; ++y) {
@@ -79,14 +635,30 @@ flo::canvas::canvas( const std::vector<rgb_color>& palette, int wd, int hgt, int
             impl_[x, y] = make_one_color_paint(palette.size(), bkgd, amnt);
         }
     }
+    update_blank_state();
+}
+
+flo::storage_layout flo::canvas::layout() const {
+    return store_ ? storage_layout::tiled : impl_.layout();
+}
+
+bool flo::canvas::is_paged() const {
+    return static_cast<bool>(store_);
+}
+
+std::optional<flo::tile_store_stats> flo::canvas::paging_stats() const {
+    if (!store_) {
+        return {};
+    }
+    return store_->stats();
 }
 
 int flo::canvas::cols() const {
-    return impl_.cols();
+    return store_ ? store_->cols() : impl_.cols();
 }
 
 int flo::canvas::rows() const {
-    return  impl_.rows();
+    return store_ ? store_->rows() : impl_.rows();
 }
 
 int flo::canvas::layers() const {
@@ -94,84 +666,218 @@ int flo::canvas::layers() const {
 }
 
 flo::dimensions flo::canvas::bounds() const {
-    return impl_.bounds();
+    return { cols(), rows() };
 }
 
 flo::pigment flo::canvas::color_at(int x, int y) const {
     pigment_map<double> color_to_weight;
 
     for (auto [i, pigment] : rv::enumerate(palette_)) {
-        const auto& particle = impl_[x, y];
-        color_to_weight[pigment] = particle[i];
+        color_to_weight[pigment] = (*this)[x, y, static_cast<int>(i)];
     }
 
     return mix_paint(color_to_weight);
 }
 
+const std::vector<flo::pigment>& flo::canvas::palette() const {
+    return palette_;
+}
+
 int flo::canvas::palette_size() const {
     return static_cast<int>(palette_.size());
 }
 
 int flo::canvas::num_blank_locs() const
 {
-    return r::count_if(
-        locations(impl_.bounds()),
-        [&](auto&& pp) {
-            auto [x, y] = pp;
-            return volume_at(x,y) == 0.0;
-        }
-    );
+    return tiled_blank_cells_ ? tiled_blank_cells_->size() : blank_cells_.size();
 }
 
 std::vector<flo::coords> flo::canvas::blank_locs() const
 {
-    return locations(impl_.bounds()) | rv::filter(
-            [&](auto&& pair) {
-                auto [x, y] = pair;
-                return volume_at(x, y) == 0.0;
-            }
-        ) | rv::transform(
-            [&](auto&& pair)->coords {
-                auto [x, y] = pair;
-                return { x,y };
+    return rv::iota(0, num_blank_locs()) | rv::transform(
+            [&](int i)->coords {
+                return blank_loc(i);
             }
         ) | r::to<std::vector>();
 }
 
+flo::coords flo::canvas::blank_loc(int i) const
+{
+    auto cell = tiled_blank_cells_ ? (*tiled_blank_cells_)[i] : blank_cells_[i];
+    return { cell % cols(), cell / cols() };
+}
+
 double flo::canvas::volume_at(int x, int y) const
 {
+    const paint_value* cell = cell_ptr(x, y);
+    auto stride = layer_stride();
     double vol = 0;
-    for (auto v : impl_[x, y]) {
-        vol += v;
+    for (int i = 0; i < layers(); ++i) {
+        vol += cell[i * stride];
     }
     return vol;
 }
 
+void flo::canvas::row_volumes(int y, int x_begin, int x_end, double* volumes) const {
+    if (layer_stride() == 1) {
+        for (int x = x_begin; x < x_end; ++x) {
+            volumes[x - x_begin] = volume_at(x, y);
+        }
+        return;
+    }
+
+    // accumulate plane by plane so that each sweep is unit-stride.
+    std::fill_n(volumes, x_end - x_begin, 0.0);
+    for (int x = x_begin; x < x_end;) {
+        int n = std::min(contiguous_cells(x), x_end - x);
+        auto [cells, cell_stride, layer_stride, layers, len] = run(x, y, n);
+        for (int z = 0; z < layers; ++z) {
+            const paint_value* layer = cells + z * layer_stride;
+            for (int i = 0; i < n; ++i) {
+                volumes[x - x_begin + i] += layer[i * cell_stride];
+            }
+        }
+        x += n;
+    }
+}
+
+void flo::canvas::update_blank_state(const coords& loc) {
+    update_blank_state(loc.x, loc.y, 1);
+}
+
+void flo::canvas::update_blank_state(int x, int y, int run_length) {
+    int cell = y * cols() + x;
+    bool painted = false;
+    for (int i = 0; i < run_length; ++i) {
+        bool blank = volume_at(x + i, y) == 0.0;
+        update_blank_cell(cell + i, blank);
+        painted = painted || !blank;
+    }
+    dirty_tiles_.mark(x, x + run_length, y,
+        painted ? (dirty_tiles::k_painted | dirty_tiles::k_changed) : dirty_tiles::k_changed);
+}
+
+void flo::canvas::update_blank_state(const rect& region) {
+    int x_begin = std::max(region.min.x, 0);
+    int x_end = std::min(region.max.x + 1, cols());
+    if (x_begin >= x_end) {
+        return;
+    }
+    std::vector<double> volumes(x_end - x_begin);
+    for (int y = std::max(region.min.y, 0); y <= std::min(region.max.y, rows() - 1); ++y) {
+        row_volumes(y, x_begin, x_end, volumes.data());
+        int painted_begin = x_end;
+        int painted_end = x_begin;
+        for (int x = x_begin; x < x_end; ++x) {
+            bool blank = volumes[x - x_begin] == 0.0;
+            update_blank_cell(y * cols() + x, blank);
+            if (!blank) {
+                painted_begin = std::min(painted_begin, x);
+                painted_end = x + 1;
+            }
+        }
+        dirty_tiles_.mark(x_begin, x_end, y, dirty_tiles::k_changed);
+        if (painted_begin < painted_end) {
+            dirty_tiles_.mark(painted_begin, painted_end, y, dirty_tiles::k_painted);
+        }
+    }
+}
+
+void flo::canvas::update_blank_state() {
+    dirty_tiles_.clear(dirty_tiles::k_painted);
+    update_blank_state(rect{ {0, 0}, {cols() - 1, rows() - 1} });
+}
+
+void flo::canvas::apply_blank_updates(std::span<const int> log) {
+    blank_cells_.apply(log);
+}
+
+const flo::dirty_tiles& flo::canvas::tiles() const {
+    return dirty_tiles_;
+}
+
+void flo::canvas::clear_changed_tiles() {
+    dirty_tiles_.clear(dirty_tiles::k_changed);
+}
+
+void flo::canvas::swap_cells(matrix_3d<paint_value>& cells) {
+    if (store_) {
+        throw std::logic_error("the cells of a paged canvas cannot be swapped");
+    }
+    std::swap(impl_, cells);
+}
+
+void flo::canvas::copy_tiles(const canvas& source, std::span<const uint8_t> tiles) {
+    // a dirty tile lies within one tile of the tiled layout, so its rows are contiguous
+    // within each layer in every layout.
+    static_assert(dirty_tiles::k_tile_size == matrix_3d<paint_value>::k_tile_size);
+
+    auto layer_stride = this->layer_stride();
+    for (int tile_y = 0; tile_y < dirty_tiles_.rows(); ++tile_y) {
+        for (int tile_x = 0; tile_x < dirty_tiles_.cols(); ++tile_x) {
+            if (!tiles[tile_y * dirty_tiles_.cols() + tile_x]) {
+                continue;
+            }
+            dirty_tiles_.copy_tile(source.dirty_tiles_, tile_x, tile_y);
+            auto [min, max] = dirty_tiles_.tile_bounds(tile_x, tile_y, bounds());
+            int n = max.x + 1 - min.x;
+            for (int y = min.y; y <= max.y; ++y) {
+                const auto* from = source.cell_ptr(min.x, y);
+                auto* to = cell_ptr(min.x, y);
+                if (layer_stride == 1) {
+                    std::copy_n(from, n * layers(), to);
+                    continue;
+                }
+                for (int layer = 0; layer < layers(); ++layer) {
+                    std::copy_n(from + layer * layer_stride, n, to + layer * layer_stride);
+                }
+            }
+        }
+    }
+}
+
+std::span<flo::paint_value> flo::canvas::storage() {
+    return store_ ? store_->entries() : impl_.entries();
+}
+
+std::span<const flo::paint_value> flo::canvas::storage() const {
+    return store_ ? std::as_const(*store_).entries() : impl_.entries();
+}
+
+std::span<const int> flo::canvas::blank_cell_order() const {
+    return tiled_blank_cells_ ? tiled_blank_cells_->cells() : blank_cells_.cells();
+}
+
+std::span<const uint8_t> flo::canvas::tile_flags() const {
+    return dirty_tiles_.flags();
+}
+
+void flo::canvas::restore_blank_state(std::span<const int> blank_cells,
+        std::span<const uint8_t> tile_flags) {
+    if (tiled_blank_cells_) {
+        tiled_blank_cells_->assign(blank_cells);
+    } else {
+        blank_cells_.assign(blank_cells);
+    }
+    dirty_tiles_.assign(tile_flags);
+}
+
 double flo::brush_region_area(const dimensions& dim, const point& loc, double rad, int aa) {
-    return r::fold_left(
-        flo::brush_region(dim, loc, rad, aa) | rv::transform([](auto&& rp) {return rp.weight; }),
-        0.0,
-        std::plus<double>()
-    );
+    return brush_dab(dim, loc, rad, aa).area();
 }
 
 void flo::fill(canvas& canv, const point& loc, double radius, int aa_level, const paint_mixture& paint) {
-    for (const auto& [loc, paint_pcnt] : brush_region(canv.bounds(), loc, radius, aa_level)) {
-        canv[loc] = (1.0 - paint_pcnt) * canv[loc] + paint_pcnt * paint;
-    }
+    brush_dab(canv.bounds(), loc, radius, aa_level).fill(canv, paint);
 }
 
 void flo::overlay(canvas& canv, const point& loc, double radius, int aa_level, const paint_mixture& paint) {
-    for (const auto& [loc, paint_pcnt] : brush_region(canv.bounds(), loc, radius, aa_level)) {
-        canv[loc] += paint_pcnt * paint;
-    }
+    brush_dab(canv.bounds(), loc, radius, aa_level).overlay(canv, paint);
 }
 
 void flo::mix(canvas& canv, const point& loc, double radius, int aa_level) {
-    auto area = brush_region_area(canv.bounds(), loc, radius, aa_level);
-    auto paint_sum = all_paint_in_brush_region(canv, loc, radius, aa_level);
-    auto mean_color = (1.0 / area) * paint_sum;
-    fill(canv, loc, radius, aa_level, mean_color);
+    brush_dab dab(canv.bounds(), loc, radius, aa_level);
+    auto [area, paint_sum] = dab.gather(canv);
+    dab.fill(canv, (1.0 / area) * paint_sum);
 }
 
 flo::canvas flo::image_to_canvas(const image& img, const std::vector<rgb_color>& palette, double vol_per_pixel) {
@@ -182,6 +888,7 @@ flo::canvas flo::image_to_canvas(const image& img, const std::vector<rgb_color>&
         int palette_index = find_closest_color(color, palette);
         canv[x, y] = make_one_color_paint(n, palette_index, vol_per_pixel);
     }
+    canv.update_blank_state();
     return canv;
 }
 
@@ -191,25 +898,56 @@ flo::canvas flo::image_to_canvas(const image& img, int n, double vol_per_pixel)
 }
 
 flo::image flo::canvas_to_image(const canvas& canv, double alpha_threshold,
-        const rgb_color& canvas_color) {
-    static const auto bkgd = rgb_to_pigment(canvas_color);
+        const rgb_color& canvas_color, int num_threads) {
+    FLO_PROFILE_SCOPE("export");
+    pixel_exporter exporter(canv, alpha_threshold, canvas_color);
     flo::image img(canv.bounds());
-    for (auto [x, y] : locations(img.bounds())) {
-        auto pigment = canv.color_at(x, y);
-        auto volume = canv.volume_at(x, y);
-        if (alpha_threshold > 0.0) {
-            auto alpha = (volume >= alpha_threshold) ? 1.0 : volume / alpha_threshold;
-            pigment = mix_pigments(bkgd, (1.0 - alpha), pigment, alpha);
+    auto pixels_at = [&](int x, int y) {
+        return reinterpret_cast<uint32_t*>(img.data()) + static_cast<ptrdiff_t>(y) * img.cols() + x;
+    };
+
+    // every cell of an unpainted tile is blank, so the color of one blank cell is
+    // computed once and used to fill them all.
+    const auto& tiles = canv.tiles();
+    std::optional<uint32_t> blank_pixel;
+    for (int tile_y = 0; tile_y < tiles.rows() && !blank_pixel; ++tile_y) {
+        for (int tile_x = 0; tile_x < tiles.cols() && !blank_pixel; ++tile_x) {
+            if (!tiles.is_painted(tile_x, tile_y)) {
+                auto [min, max] = tiles.tile_bounds(tile_x, tile_y, canv.bounds());
+                blank_pixel.emplace();
+                exporter.to_pixels(canv.run(min.x, min.y, 1), &*blank_pixel);
+            }
         }
-        img[x, y] = rgb_to_pixel(pigment_to_rgb(pigment));
     }
+
+    thread_pool pool(num_threads);
+    if (auto paging = canv.paging_stats()) {
+        export_paged_tiles(canv, exporter, blank_pixel, paging->capacity, pool, pixels_at);
+        return img;
+    }
+
+    pool.parallel_for(canv.rows(),
+        [&](int y) {
+            int tile_y = y / dirty_tiles::k_tile_size;
+            for (int tile_x = 0; tile_x < tiles.cols(); ++tile_x) {
+                auto [min, max] = tiles.tile_bounds(tile_x, tile_y, canv.bounds());
+                if (!tiles.is_painted(tile_x, tile_y)) {
+                    std::fill(pixels_at(min.x, y), pixels_at(max.x + 1, y), *blank_pixel);
+                    continue;
+                }
+                for (int x = min.x; x <= max.x;) {
+                    int n = std::min({
+                        canv.contiguous_cells(x), max.x + 1 - x, pigment_batch::k_size
+                    });
+                    exporter.to_pixels(canv.run(x, y, n), pixels_at(x, y));
+                    x += n;
+                }
+            }
+        }
+    );
     return img;
 }
 
 flo::paint_mixture flo::all_paint_in_brush_region(canvas& canv, const point& loc, double radius, int aa_level) {
-    flo::paint_mixture sum(std::vector<double>(canv.palette_size(), 0.0));
-    for (const auto& [loc, paint_pcnt] : brush_region(canv.bounds(), loc, radius, aa_level)) {
-        sum += paint_pcnt * flo::paint_mixture{ canv[loc] };
-    }
-    return sum;
+    return brush_dab(canv.bounds(), loc, radius, aa_level).gather(canv).paint;
 }
\ No newline at end of file
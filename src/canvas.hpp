@@ -4,20 +4,196 @@
 #include "pigment.hpp"
 #include "matrix_3d.hpp"
 #include "paint_mixture.hpp"
+#include "tile_store.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
 
 /*------------------------------------------------------------------------------------------------*/
 
 namespace flo {
 
+    // the set of canvas cells that hold no paint. It is kept up to date as cells are
+    // painted so that coverage checks and white space sampling run in constant time.
+    // Cells are stored compactly with swap-removal, so sampling uniformly from the set
+    // is a single random index. Cells may be updated from several threads as long as
+    // no two threads update the same cell. The order of the set depends on the order of
+    // updates, so threads that must leave it in a reproducible order hold a deferral,
+    // which logs their changes for replay in a fixed order with apply().
+
+    class blank_cell_set {
+        std::vector<int> cells_;
+        std::vector<int> slots_;
+        std::vector<uint8_t> blank_;
+        mutable std::mutex mutex_;
+
+        void sync_membership(int cell);
+
+    public:
+        class deferral {
+            std::vector<int>* previous_;
+        public:
+            explicit deferral(std::vector<int>& log);
+            deferral(const deferral&) = delete;
+            deferral& operator=(const deferral&) = delete;
+            ~deferral();
+        };
+
+        blank_cell_set(int num_cells = 0);
+        blank_cell_set(const blank_cell_set& other);
+        blank_cell_set(blank_cell_set&& other) noexcept;
+        blank_cell_set& operator=(const blank_cell_set& other);
+        blank_cell_set& operator=(blank_cell_set&& other) noexcept;
+
+        void update(int cell, bool blank);
+        void apply(std::span<const int> log);
+        bool contains(int cell) const;
+        int size() const;
+        int operator[](int i) const;
+
+        // the cells in the order they are sampled from, and replacing the contents of
+        // the set with cells in that order.
+        std::span<const int> cells() const;
+        void assign(std::span<const int> cells);
+    };
+
+    // flags over square tiles of a canvas recording which tiles have ever held paint and
+    // which have been written since the changed flags were last cleared, so passes over
+    // the whole canvas can skip tiles that are blank. Flags may be set from several
+    // threads at once.
+
+    class dirty_tiles {
+        int cols_;
+        int rows_;
+        std::vector<uint8_t> flags_;
+
+    public:
+        static constexpr int k_tile_size = 64;
+        static constexpr uint8_t k_painted = 1;
+        static constexpr uint8_t k_changed = 2;
+
+        dirty_tiles(const dimensions& canvas_dim = { 0, 0 });
+
+        // flags the tiles overlapping cells [x_begin, x_end) of row y.
+        void mark(int x_begin, int x_end, int y, uint8_t flags);
+        void clear(uint8_t flags);
+
+        int cols() const;
+        int rows() const;
+        bool is_painted(int tile_x, int tile_y) const;
+        bool is_changed(int tile_x, int tile_y) const;
+        bool any_painted() const;
+
+        // the canvas cells covered by a tile.
+        rect tile_bounds(int tile_x, int tile_y, const dimensions& canvas_dim) const;
+
+        std::span<const uint8_t> flags() const;
+        void assign(std::span<const uint8_t> flags);
+        void copy_tile(const dirty_tiles& source, int tile_x, int tile_y);
+    };
+
+    // the set of blank cells of a paged canvas, which may have too many cells to list. It
+    // keeps a count of blank cells per tile, and lists the blank cells of a tile as
+    // blank_cell_set does only once the tile has been partly painted: a tile that has never
+    // been painted holds all of its cells in row-major order, and a tile with none left
+    // drops its list. The i-th cell is found by locating the tile holding index i from a
+    // tree of prefix sums of the counts, then the cell within the tile. Paged canvases are
+    // painted from one thread, so updates are applied at once rather than deferred.
+    //
+    // cells() lists the tiles in order, each as its blank cells in order or, if it has
+    // never been painted, as -(tile + 1).
+
+    class tiled_blank_cell_set {
+        struct tile_cells {
+            std::vector<uint16_t> cells;
+            std::vector<uint16_t> slots;
+        };
+
+        static constexpr int k_tile_size = dirty_tiles::k_tile_size;
+        static constexpr uint16_t k_no_slot = 0xffff;
+
+        int cols_;
+        int rows_;
+        int tiles_x_;
+        int size_;
+        std::vector<int> counts_;
+        std::vector<int> sums_;
+        std::vector<std::unique_ptr<tile_cells>> lists_;
+        mutable std::vector<int> order_;
+
+        dimensions tile_dimensions(int tile) const;
+        void add_to_count(int tile, int delta);
+        void rebuild_sums();
+        tile_cells& cells_of(int tile);
+
+    public:
+        tiled_blank_cell_set(const dimensions& canvas_dim);
+
+        void update(int cell, bool blank);
+        bool contains(int cell) const;
+        int size() const;
+        int operator[](int i) const;
+
+        std::span<const int> cells() const;
+        void assign(std::span<const int> cells);
+    };
+
+    // the paint of a canvas is either held in memory in a matrix_3d or, for a paged
+    // canvas, in a tile_store that keeps only some of its tiles in memory. A paged canvas
+    // is laid out as a tiled one, keeps its blank cells in a tiled_blank_cell_set, and
+    // cannot be copied or have its cells swapped.
+
     class canvas {
         std::vector<pigment> palette_;
-        matrix_3d<double> impl_;
+        matrix_3d<paint_value> impl_;
+        std::unique_ptr<tile_store> store_;
+        blank_cell_set blank_cells_;
+        std::unique_ptr<tiled_blank_cell_set> tiled_blank_cells_;
+        dirty_tiles dirty_tiles_;
+
+        inline paint_value* cell_ptr(int x, int y) {
+            return store_ ? store_->cell_ptr(x, y) : impl_.cell_ptr(x, y);
+        }
+
+        inline const paint_value* cell_ptr(int x, int y) const {
+            return store_ ? store_->cell_ptr(x, y) : impl_.cell_ptr(x, y);
+        }
+
+        inline std::ptrdiff_t cell_stride() const {
+            return store_ ? store_->cell_stride() : impl_.cell_stride();
+        }
+
+        inline std::ptrdiff_t layer_stride() const {
+            return store_ ? store_->layer_stride() : impl_.layer_stride();
+        }
+
+        inline void update_blank_cell(int cell, bool blank) {
+            if (tiled_blank_cells_) {
+                tiled_blank_cells_->update(cell, blank);
+            } else {
+                blank_cells_.update(cell, blank);
+            }
+        }
+
+        void row_volumes(int y, int x_begin, int x_end, double* volumes) const;
+
     public:
         canvas() {}
-        canvas(const std::vector<rgb_color>& palette, int wd, int hgt);
-        canvas(const std::vector<rgb_color>& palette, const dimensions& dim);
+        canvas(const std::vector<rgb_color>& palette, int wd, int hgt,
+            storage_layout layout = storage_layout::interleaved);
+        canvas(const std::vector<rgb_color>& palette, const dimensions& dim,
+            storage_layout layout = storage_layout::interleaved);
         canvas(const std::vector<rgb_color>& palette, int wd, int hgt, int bkgd, double amnt);
+        canvas(const std::vector<rgb_color>& palette, const dimensions& dim,
+            const paging_params& paging);
+
+        canvas(const canvas& other);
+        canvas(canvas&& other) = default;
+        canvas& operator=(const canvas& other);
+        canvas& operator=(canvas&& other) = default;
 
+        // whole cells of a canvas held in memory.
         inline auto operator[](const coords& loc) {
             return impl_[loc];
         }
@@ -34,16 +210,76 @@ namespace flo {
             return impl_[x,y];
         }
 
+        inline paint_value& operator[](int x, int y, int layer) {
+            return cell_ptr(x, y)[layer * layer_stride()];
+        }
+
+        inline paint_value operator[](int x, int y, int layer) const {
+            return cell_ptr(x, y)[layer * layer_stride()];
+        }
+
+        // unchecked access to n cells starting at (x, y). n must not exceed
+        // contiguous_cells(x). On a paged canvas the run is only good until another tile
+        // is accessed.
+        inline cell_run run(int x, int y, int n) {
+            return { cell_ptr(x, y), cell_stride(), layer_stride(), layers(), n };
+        }
+
+        inline const_cell_run run(int x, int y, int n) const {
+            return { cell_ptr(x, y), cell_stride(), layer_stride(), layers(), n };
+        }
+
+        inline int contiguous_cells(int x) const {
+            return store_ ? store_->contiguous_cells(x) : impl_.contiguous_cells(x);
+        }
+
+        storage_layout layout() const;
+        bool is_paged() const;
+        std::optional<tile_store_stats> paging_stats() const;
         int cols() const;
         int rows() const;
         int layers() const;
         dimensions bounds() const;
 
         pigment color_at(int x, int y) const;
+        const std::vector<pigment>& palette() const;
         int palette_size() const;
         int num_blank_locs() const;
         std::vector<coords> blank_locs() const;
+        coords blank_loc(int i) const;
         double volume_at(int x, int y) const;
+
+        // code that writes cells directly through operator[] must report the cells it
+        // wrote so that the set of blank cells and the dirty tiles stay current.
+        void update_blank_state(const coords& loc);
+        void update_blank_state(int x, int y, int run_length);
+        void update_blank_state(const rect& region);
+        void update_blank_state();
+        void apply_blank_updates(std::span<const int> log);
+
+        // every cell of a tile that has never been painted is blank.
+        const dirty_tiles& tiles() const;
+        void clear_changed_tiles();
+
+        // exchanges the canvas's cells with a matrix of the same dimensions and layout.
+        void swap_cells(matrix_3d<paint_value>& cells);
+
+        // copies the paint and flags of the tiles flagged in tiles, one entry per tile in
+        // row-major order, from a canvas of the same dimensions, palette and layout. The
+        // set of blank cells is left as it is.
+        void copy_tiles(const canvas& source, std::span<const uint8_t> tiles);
+
+        // the canvas's state as flat arrays, for checkpoints: the paint in storage order,
+        // the blank cells in the order they are sampled from, compacted by tile for a paged
+        // canvas as tiled_blank_cell_set::cells() describes, and the tile flags. A canvas
+        // of the same dimensions, palette size, layout and paging is restored by writing
+        // the paint through storage() and then calling restore_blank_state().
+        std::span<paint_value> storage();
+        std::span<const paint_value> storage() const;
+        std::span<const int> blank_cell_order() const;
+        std::span<const uint8_t> tile_flags() const;
+        void restore_blank_state(std::span<const int> blank_cells,
+            std::span<const uint8_t> tile_flags);
     };
 
     double brush_region_area(const dimensions& canvas_dimensions,
@@ -62,7 +298,8 @@ namespace flo {
     canvas image_to_canvas(const image& img, const std::vector<rgb_color>& palette, double vol_per_pixel = 1.0);
     canvas image_to_canvas(const image& img, int n, double vol_per_pixel = 1.0);
 
+    // num_threads of 0 means one thread per hardware core.
     image canvas_to_image(const canvas& canv, double alpha_threshold, 
-        const rgb_color& canvas_color = {255,255,255});
+        const rgb_color& canvas_color = {255,255,255}, int num_threads = 1);
 
 }
\ No newline at end of file
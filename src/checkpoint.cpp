@@ -0,0 +1,199 @@
+#include "checkpoint.hpp"
+#include "mapped_file.hpp"
+#include "random.hpp"
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr std::array<char, 8> k_magic = { 'F', 'L', 'O', 'C', 'K', 'P', 'T', '\0' };
+    constexpr uint32_t k_version = 1;
+    constexpr size_t k_alignment = 64;
+
+    struct header {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t paint_value_size;
+        uint32_t paint_mixture_size;
+        uint32_t max_palette_size;
+        int32_t cols;
+        int32_t rows;
+        int32_t layers;
+        int32_t layout;
+        int32_t history_capacity;
+        int32_t num_particles;
+        int32_t num_blank_entries;
+        int32_t layer;
+        int32_t iters;
+        int32_t prior_iters;
+        double elapsed;
+        flo::rng_streams_state rng;
+    };
+
+    static_assert(std::is_trivially_copyable_v<header>);
+    static_assert(std::is_trivially_copyable_v<flo::paint_mixture>);
+    static_assert(std::is_trivially_copyable_v<flo::rng_stream>);
+
+    size_t aligned(size_t offset) {
+        return (offset + k_alignment - 1) / k_alignment * k_alignment;
+    }
+
+    // lays sections out one after another, each starting on an aligned offset. Without
+    // a buffer it only measures.
+    class section_writer {
+        std::byte* data_;
+        size_t offset_;
+
+    public:
+        section_writer(std::byte* data = nullptr) :
+            data_(data),
+            offset_(aligned(sizeof(header)))
+        {}
+
+        template<typename T>
+        void write(std::span<const T> values) {
+            if (data_) {
+                std::memcpy(data_ + offset_, values.data(), values.size_bytes());
+            }
+            offset_ = aligned(offset_ + values.size_bytes());
+        }
+
+        size_t size() const {
+            return offset_;
+        }
+    };
+
+    class section_reader {
+        std::span<const std::byte> bytes_;
+        size_t offset_;
+
+    public:
+        section_reader(std::span<const std::byte> bytes) :
+            bytes_(bytes),
+            offset_(aligned(sizeof(header)))
+        {}
+
+        template<typename T>
+        void read(std::span<T> values) {
+            if (offset_ + values.size_bytes() > bytes_.size()) {
+                throw std::runtime_error("checkpoint is truncated");
+            }
+            std::memcpy(values.data(), bytes_.data() + offset_, values.size_bytes());
+            offset_ = aligned(offset_ + values.size_bytes());
+        }
+    };
+
+    void write_sections(section_writer& out, const flo::canvas& canv,
+            const flo::particle_pool& particles) {
+        out.write(canv.storage());
+        out.write(canv.blank_cell_order());
+        out.write(canv.tile_flags());
+        particles.visit_arrays(
+            [&](const auto& values, int per_particle) {
+                out.write(std::span(values.data(), particles.size() * per_particle));
+            }
+        );
+    }
+
+    header read_header(const flo::mapped_file& file, const std::string& fname) {
+        auto bytes = file.bytes();
+        header hdr;
+        if (bytes.size() < sizeof(header)) {
+            throw std::runtime_error("'" + fname + "' is not a flowbee checkpoint");
+        }
+        std::memcpy(&hdr, bytes.data(), sizeof(header));
+        if (hdr.magic != k_magic) {
+            throw std::runtime_error("'" + fname + "' is not a flowbee checkpoint");
+        }
+        if (hdr.version != k_version ||
+                hdr.paint_value_size != sizeof(flo::paint_value) ||
+                hdr.paint_mixture_size != sizeof(flo::paint_mixture) ||
+                hdr.max_palette_size != flo::k_max_palette_size) {
+            throw std::runtime_error(
+                "checkpoint '" + fname + "' was written by an incompatible build"
+            );
+        }
+        return hdr;
+    }
+
+}
+
+void flo::write_checkpoint(const std::string& fname, const render_progress& progress,
+        const canvas& canv, const particle_pool& particles) {
+    header hdr{
+        .magic = k_magic,
+        .version = k_version,
+        .paint_value_size = sizeof(paint_value),
+        .paint_mixture_size = sizeof(paint_mixture),
+        .max_palette_size = k_max_palette_size,
+        .cols = canv.cols(),
+        .rows = canv.rows(),
+        .layers = canv.layers(),
+        .layout = static_cast<int32_t>(canv.layout()),
+        .history_capacity = particles.history_capacity(),
+        .num_particles = particles.size(),
+        .num_blank_entries = static_cast<int32_t>(canv.blank_cell_order().size()),
+        .layer = progress.layer,
+        .iters = progress.iters,
+        .prior_iters = progress.prior_iters,
+        .elapsed = progress.elapsed,
+        .rng = rng_streams_snapshot()
+    };
+
+    section_writer measure;
+    write_sections(measure, canv, particles);
+
+    auto temp_fname = fname + ".tmp";
+    {
+        auto file = mapped_file::create(temp_fname, measure.size());
+        std::memcpy(file.bytes().data(), &hdr, sizeof(header));
+        section_writer out(file.bytes().data());
+        write_sections(out, canv, particles);
+        // the data must reach the disk before the rename can, or a crash could leave a
+        // partly written file in place of the previous checkpoint.
+        file.flush();
+    }
+    std::filesystem::rename(temp_fname, fname);
+}
+
+flo::render_progress flo::read_checkpoint(const std::string& fname, canvas& canv,
+        particle_pool& particles) {
+    auto file = mapped_file::open_for_reading(fname);
+    auto hdr = read_header(file, fname);
+    if (hdr.cols != canv.cols() || hdr.rows != canv.rows() || hdr.layers != canv.layers() ||
+            hdr.layout != static_cast<int32_t>(canv.layout())) {
+        throw std::runtime_error(
+            "checkpoint '" + fname + "' does not match the canvas of the input"
+        );
+    }
+
+    section_reader in(file.bytes());
+    in.read(canv.storage());
+    std::vector<int> blank_cells(hdr.num_blank_entries);
+    in.read(std::span(blank_cells));
+    std::vector<uint8_t> tile_flags(canv.tile_flags().size());
+    in.read(std::span(tile_flags));
+    canv.restore_blank_state(blank_cells, tile_flags);
+
+    particles = particle_pool(hdr.history_capacity);
+    particles.resize(hdr.num_particles);
+    particles.visit_arrays(
+        [&](auto& values, int per_particle) {
+            in.read(std::span(values.data(), particles.size() * per_particle));
+        }
+    );
+
+    restore_rng_streams(hdr.rng);
+    return { hdr.layer, hdr.iters, hdr.elapsed, hdr.prior_iters };
+}
+
+uint64_t flo::checkpoint_seed(const std::string& fname) {
+    auto file = mapped_file::open_for_reading(fname);
+    return read_header(file, fname).rng.seed;
+}
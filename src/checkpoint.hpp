@@ -0,0 +1,47 @@
+#pragma once
+
+#include "canvas.hpp"
+#include "particle_pool.hpp"
+#include <cstdint>
+#include <string>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // every is in iterations counted over all layers; 0 means no checkpoints are written.
+    // An empty resume_from starts the render from the beginning.
+    struct checkpoint_params {
+        std::string filename;
+        int every = 0;
+        std::string resume_from;
+    };
+
+    // where a render stands between two iterations: the layer, the iterations and time
+    // elapsed within it, and the iterations of the layers before it.
+    struct render_progress {
+        int layer;
+        int iters;
+        double elapsed;
+        int prior_iters;
+    };
+
+    // a checkpoint is a header followed by the raw arrays of the canvas, the particles and
+    // the random streams, each starting on a cache line, so it is written and read by
+    // copying through a mapping of the file. It is only readable by a build with the same
+    // paint representation, palette capacity and byte order. Checkpoints are written to a
+    // temporary file that is then renamed, so an interrupted write leaves the previous
+    // checkpoint intact.
+    void write_checkpoint(const std::string& fname, const render_progress& progress,
+        const canvas& canv, const particle_pool& particles);
+
+    // restores the canvas, which must already have the dimensions, palette size and layout
+    // of the checkpointed canvas, the particles and the random streams.
+    render_progress read_checkpoint(const std::string& fname, canvas& canv,
+        particle_pool& particles);
+
+    // the seed of the checkpointed run. Input that draws random numbers, such as perlin
+    // fields, must be parsed with the streams seeded with it to come out the same.
+    uint64_t checkpoint_seed(const std::string& fname);
+
+}
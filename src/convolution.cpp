@@ -0,0 +1,195 @@
+#include "convolution.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <numbers>
+#include <stdexcept>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    using complex = std::complex<double>;
+
+    // written out rather than using std::complex's operator*, which handles infinities
+    // and NaNs through a library call.
+    complex mul(const complex& a, const complex& b) {
+        return {
+            a.real() * b.real() - a.imag() * b.imag(),
+            a.real() * b.imag() + a.imag() * b.real()
+        };
+    }
+
+    // filters sequences of a fixed length through a radix-2 FFT. The transform is complex
+    // and the kernel is real, so two real sequences are filtered at once as the real and
+    // imaginary parts of one transform.
+    class fft_filter {
+        int n_;
+        std::vector<complex> twiddles_;
+        std::vector<complex> kernel_spectrum_;
+
+        void transform(std::vector<complex>& a, bool inverse) const {
+            for (int i = 1, j = 0; i < n_; ++i) {
+                int bit = n_ >> 1;
+                for (; j & bit; bit >>= 1) {
+                    j ^= bit;
+                }
+                j ^= bit;
+                if (i < j) {
+                    std::swap(a[i], a[j]);
+                }
+            }
+            for (int len = 2; len <= n_; len <<= 1) {
+                int half = len / 2;
+                int step = n_ / len;
+                for (int i = 0; i < n_; i += len) {
+                    for (int k = 0; k < half; ++k) {
+                        auto w = inverse ? std::conj(twiddles_[k * step]) : twiddles_[k * step];
+                        auto u = a[i + k];
+                        auto v = mul(a[i + k + half], w);
+                        a[i + k] = u + v;
+                        a[i + k + half] = u - v;
+                    }
+                }
+            }
+        }
+
+    public:
+        // the transform is long enough that the kernel never wraps around onto cells of
+        // a sequence of length len.
+        fft_filter(const std::vector<double>& kernel, int len) {
+            int half_sz = static_cast<int>(kernel.size()) / 2;
+            n_ = static_cast<int>(std::bit_ceil(static_cast<unsigned>(len + half_sz)));
+
+            twiddles_.resize(n_ / 2);
+            for (int k = 0; k < n_ / 2; ++k) {
+                double angle = -2.0 * std::numbers::pi * k / n_;
+                twiddles_[k] = { std::cos(angle), std::sin(angle) };
+            }
+
+            // the filter is a correlation, so the kernel is stored reversed, and the
+            // spectrum carries the 1/n of the inverse transform.
+            kernel_spectrum_.assign(n_, complex{ 0.0, 0.0 });
+            for (int k = -half_sz; k <= half_sz; ++k) {
+                kernel_spectrum_[(n_ - k) % n_] = kernel[half_sz + k] / n_;
+            }
+            transform(kernel_spectrum_, false);
+        }
+
+        int size() const {
+            return n_;
+        }
+
+        // filters len values of in_0 and in_1, each stride apart, into out_0 and out_1;
+        // in_1 and out_1 may be null. buffer is scratch space of size() entries.
+        void apply(int len, int stride, const double* in_0, const double* in_1,
+                double* out_0, double* out_1, std::vector<complex>& buffer) const {
+            for (int i = 0; i < len; ++i) {
+                buffer[i] = { in_0[i * stride], in_1 ? in_1[i * stride] : 0.0 };
+            }
+            std::fill(buffer.begin() + len, buffer.end(), complex{ 0.0, 0.0 });
+
+            transform(buffer, false);
+            for (int i = 0; i < n_; ++i) {
+                buffer[i] = mul(buffer[i], kernel_spectrum_[i]);
+            }
+            transform(buffer, true);
+
+            for (int i = 0; i < len; ++i) {
+                out_0[i * stride] = buffer[i].real();
+                if (out_1) {
+                    out_1[i * stride] = buffer[i].imag();
+                }
+            }
+        }
+    };
+
+    void check_kernel(const std::vector<double>& kernel) {
+        if (kernel.size() % 2 == 0) {
+            throw std::invalid_argument("filter kernel size must be odd");
+        }
+    }
+
+    // filters a field's rows (stride 1, len cols) or columns (stride cols, len rows)
+    // in pairs through the FFT.
+    flo::scalar_field fft_filter_lines(const flo::scalar_field& field,
+            const std::vector<double>& kernel, bool rows, flo::thread_pool& pool) {
+        int num_lines = rows ? field.rows() : field.cols();
+        int len = rows ? field.cols() : field.rows();
+        int stride = rows ? 1 : field.cols();
+        auto line = [&](auto& f, int i) {
+            return rows ? &f[0, i] : &f[i, 0];
+        };
+
+        flo::scalar_field filtered(field.bounds());
+        fft_filter filter(kernel, len);
+        pool.parallel_for((num_lines + 1) / 2,
+            [&](int pair) {
+                std::vector<complex> buffer(filter.size());
+                int i = 2 * pair;
+                bool has_second = i + 1 < num_lines;
+                filter.apply(len, stride,
+                    line(field, i), has_second ? line(field, i + 1) : nullptr,
+                    line(filtered, i), has_second ? line(filtered, i + 1) : nullptr,
+                    buffer
+                );
+            }
+        );
+        return filtered;
+    }
+
+}
+
+flo::scalar_field flo::filter_rows(const scalar_field& field, const std::vector<double>& kernel,
+        thread_pool& pool) {
+    check_kernel(kernel);
+    if (static_cast<int>(kernel.size()) >= k_fft_min_kernel_sz) {
+        return fft_filter_lines(field, kernel, true, pool);
+    }
+
+    int wd = field.cols();
+    int half_sz = static_cast<int>(kernel.size()) / 2;
+    scalar_field filtered(field.bounds(), 0.0);
+    pool.parallel_for(field.rows(),
+        [&](int y) {
+            const double* in = &field[0, y];
+            double* out = &filtered[0, y];
+            for (int k = -half_sz; k <= half_sz; ++k) {
+                double coeff = kernel[half_sz + k];
+                int x_begin = std::max(0, -k);
+                int x_end = std::min(wd, wd - k);
+                if (coeff != 0.0 && x_begin < x_end) {
+                    simd::axpy(out + x_begin, coeff, in + x_begin + k, x_end - x_begin);
+                }
+            }
+        }
+    );
+    return filtered;
+}
+
+flo::scalar_field flo::filter_cols(const scalar_field& field, const std::vector<double>& kernel,
+        thread_pool& pool) {
+    check_kernel(kernel);
+    if (static_cast<int>(kernel.size()) >= k_fft_min_kernel_sz) {
+        return fft_filter_lines(field, kernel, false, pool);
+    }
+
+    int wd = field.cols();
+    int hgt = field.rows();
+    int half_sz = static_cast<int>(kernel.size()) / 2;
+    scalar_field filtered(field.bounds(), 0.0);
+    pool.parallel_for(hgt,
+        [&](int y) {
+            double* out = &filtered[0, y];
+            for (int k = std::max(-half_sz, -y); k <= std::min(half_sz, hgt - 1 - y); ++k) {
+                double coeff = kernel[half_sz + k];
+                if (coeff != 0.0) {
+                    simd::axpy(out, coeff, &field[0, y + k], wd);
+                }
+            }
+        }
+    );
+    return filtered;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include "types.hpp"
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // one-dimensional filters of a scalar field along its rows or its columns. With a
+    // kernel of odd length 2h + 1, each cell becomes the sum over k in [-h, h] of
+    // kernel[h + k] times the cell k away; cells beyond the edge of the field count as 0.
+    // Kernels of at least k_fft_min_kernel_sz taps are applied through the FFT, shorter
+    // ones directly. Rows, or columns, are filtered in parallel.
+
+    constexpr int k_fft_min_kernel_sz = 127;
+
+    scalar_field filter_rows(const scalar_field& field, const std::vector<double>& kernel,
+        thread_pool& pool);
+    scalar_field filter_cols(const scalar_field& field, const std::vector<double>& kernel,
+        thread_pool& pool);
+
+}
@@ -0,0 +1,175 @@
+#include "diffusion.hpp"
+#include <algorithm>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    // the 5-point stencil over n elements with unit stride. Horizontal neighbors are dx
+    // elements away in the same run; vertical neighbors are read from the runs above and
+    // below, which need not be adjacent in memory.
+    void diffuse_run(flo::paint_value* out, const flo::paint_value* center,
+            const flo::paint_value* above, const flo::paint_value* below,
+            std::ptrdiff_t dx, int n, double rate) {
+        for (int i = 0; i < n; ++i) {
+            double laplacian =
+                center[i + dx] + center[i - dx] + below[i] + above[i] - 4.0 * center[i];
+            out[i] = center[i] + rate * laplacian;
+        }
+    }
+
+    void diffuse_cell(flo::matrix_3d<flo::paint_value>& out, const flo::canvas& canv,
+            int x, int y, double rate) {
+        for (int i = 0; i < canv.layers(); ++i) {
+            double laplacian =
+                canv[x + 1, y, i] + canv[x - 1, y, i] +
+                canv[x, y + 1, i] + canv[x, y - 1, i] -
+                4.0 * canv[x, y, i];
+            out[x, y, i] = canv[x, y, i] + rate * laplacian;
+        }
+    }
+
+}
+
+void flo::diffusion_engine::diffuse_row(
+        const canvas& canv, int y, int x_begin, int x_end, double rate) {
+
+    if (canv.layout() == storage_layout::interleaved) {
+        // the layers of a row are one flat run, with horizontal neighbors a cell apart.
+        auto stride = back_buffer_.cell_stride();
+        diffuse_run(
+            back_buffer_.cell_ptr(x_begin, y), canv.run(x_begin, y, 1).cells,
+            canv.run(x_begin, y - 1, 1).cells, canv.run(x_begin, y + 1, 1).cells,
+            stride, static_cast<int>((x_end - x_begin) * stride), rate
+        );
+        return;
+    }
+
+    // planar storage is swept one layer at a time. Tiled storage is swept a tile at a
+    // time, with cells on tile edges, whose neighbors are in another tile, done singly.
+    bool tiled = canv.layout() == storage_layout::tiled;
+    for (int x = x_begin; x < x_end;) {
+        int n = std::min(canv.contiguous_cells(x), x_end - x);
+        int run_begin = x;
+        int run_end = x + n;
+        if (tiled) {
+            if (x % matrix_3d<paint_value>::k_tile_size == 0) {
+                diffuse_cell(back_buffer_, canv, run_begin++, y, rate);
+            }
+            if (run_end % matrix_3d<paint_value>::k_tile_size == 0 && run_begin < run_end) {
+                diffuse_cell(back_buffer_, canv, --run_end, y, rate);
+            }
+        }
+        if (run_begin < run_end) {
+            int len = run_end - run_begin;
+            auto center = canv.run(run_begin, y, len);
+            auto above = canv.run(run_begin, y - 1, len);
+            auto below = canv.run(run_begin, y + 1, len);
+            auto out = back_buffer_.cell_ptr(run_begin, y);
+            for (int z = 0; z < canv.layers(); ++z) {
+                auto offset = z * center.layer_stride;
+                diffuse_run(
+                    out + offset, center.cells + offset,
+                    above.cells + offset, below.cells + offset, 1, len, rate
+                );
+            }
+        }
+        x += n;
+    }
+}
+
+void flo::diffusion_engine::copy_cells(const canvas& canv, int y, int x_begin, int x_end) {
+    for (int x = x_begin; x < x_end; ++x) {
+        for (int i = 0; i < canv.layers(); ++i) {
+            back_buffer_[x, y, i] = canv[x, y, i];
+        }
+    }
+}
+
+void flo::diffusion_engine::diffuse_span(
+        const canvas& canv, int y, int x_begin, int x_end, double rate) {
+    // cells on the edges of the canvas do not diffuse and are copied.
+    if (y == 0 || y == canv.rows() - 1) {
+        copy_cells(canv, y, x_begin, x_end);
+        return;
+    }
+    if (x_begin == 0) {
+        copy_cells(canv, y, 0, 1);
+    }
+    if (x_end == canv.cols()) {
+        copy_cells(canv, y, canv.cols() - 1, canv.cols());
+    }
+    int stencil_begin = std::max(x_begin, 1);
+    int stencil_end = std::min(x_end, canv.cols() - 1);
+    if (stencil_begin < stencil_end) {
+        diffuse_row(canv, y, stencil_begin, stencil_end, rate);
+    }
+}
+
+void flo::diffusion_engine::find_active_spans(const canvas& canv) {
+    // paint spreads at most one cell per pass, so only painted tiles and the tiles beside
+    // them can change. Runs of such tiles are gathered into spans, one list per tile row.
+    const auto& tiles = canv.tiles();
+    auto is_painted = [&](int tile_x, int tile_y) {
+        return tile_x >= 0 && tile_x < tiles.cols() && tile_y >= 0 && tile_y < tiles.rows() &&
+            tiles.is_painted(tile_x, tile_y);
+    };
+
+    spans_.resize(tiles.rows());
+    rows_.clear();
+    for (int tile_y = 0; tile_y < tiles.rows(); ++tile_y) {
+        auto& spans = spans_[tile_y];
+        spans.clear();
+        for (int tile_x = 0; tile_x < tiles.cols(); ++tile_x) {
+            bool active = is_painted(tile_x, tile_y) ||
+                is_painted(tile_x - 1, tile_y) || is_painted(tile_x + 1, tile_y) ||
+                is_painted(tile_x, tile_y - 1) || is_painted(tile_x, tile_y + 1);
+            if (!active) {
+                continue;
+            }
+            auto bounds = tiles.tile_bounds(tile_x, tile_y, canv.bounds());
+            if (!spans.empty() && spans.back().max.x + 1 == bounds.min.x) {
+                spans.back().max = bounds.max;
+            } else {
+                spans.push_back(bounds);
+            }
+        }
+        if (!spans.empty()) {
+            for (int y = spans.front().min.y; y <= spans.front().max.y; ++y) {
+                rows_.push_back(y);
+            }
+        }
+    }
+}
+
+void flo::diffusion_engine::apply(canvas& canv, double diffusion_rate, thread_pool& pool) {
+    if (!canv.tiles().any_painted()) {
+        return;
+    }
+
+    if (back_buffer_.cols() != canv.cols() || back_buffer_.rows() != canv.rows() ||
+            back_buffer_.layers() != canv.layers() || back_buffer_.layout() != canv.layout()) {
+        back_buffer_ = matrix_3d<paint_value>(
+            canv.cols(), canv.rows(), canv.layers(), 0.0, canv.layout()
+        );
+    }
+
+    // every cell of the active spans is written to the back buffer. The set of active
+    // tiles only grows, so cells outside of it are blank in both buffers.
+    find_active_spans(canv);
+    pool.parallel_for(static_cast<int>(rows_.size()),
+        [&](int i) {
+            int y = rows_[i];
+            for (const auto& span : spans_[y / dirty_tiles::k_tile_size]) {
+                diffuse_span(canv, y, span.min.x, span.max.x + 1, diffusion_rate);
+            }
+        }
+    );
+
+    canv.swap_cells(back_buffer_);
+    for (const auto& spans : spans_) {
+        for (const auto& span : spans) {
+            canv.update_blank_state(span);
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "canvas.hpp"
+#include "matrix_3d.hpp"
+#include "thread_pool.hpp"
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // applies Laplacian diffusion to a canvas. The engine keeps a second buffer the size
+    // of the canvas and swaps it with the canvas's cells after each pass, so passes do
+    // not allocate. Only tiles of the canvas that have been painted, and their neighbors,
+    // into which paint can spread, are recomputed; everything else is blank in both
+    // buffers and stays blank.
+
+    class diffusion_engine {
+        matrix_3d<paint_value> back_buffer_;
+        std::vector<std::vector<rect>> spans_;
+        std::vector<int> rows_;
+
+        void find_active_spans(const canvas& canv);
+        void diffuse_span(const canvas& canv, int y, int x_begin, int x_end, double rate);
+        void diffuse_row(const canvas& canv, int y, int x_begin, int x_end, double rate);
+        void copy_cells(const canvas& canv, int y, int x_begin, int x_end);
+
+    public:
+        diffusion_engine() {}
+        void apply(canvas& canv, double diffusion_rate, thread_pool& pool);
+    };
+
+}
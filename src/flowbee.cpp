@@ -1,7 +1,16 @@
 #include "flowbee.hpp"
+#include "diffusion.hpp"
+#include "frame_writer.hpp"
 #include "paint_mixture.hpp"
-#include <deque>
+#include "particle_pool.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include <array>
+#include <future>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
@@ -10,25 +19,24 @@ namespace rv = std::ranges::views;
 
 namespace {
 
-    struct paint_particle {
-        double elapsed;
-        flo::brush brush;
-        std::deque<flo::point> history;
-    };
+    constexpr int k_step_block_size = 256;
 
-    bool is_particle_alive(const paint_particle& p, const flo::dimensions& bounds, 
-            int max_particle_history, int dead_particle_area_sz) {
-        if (!p.brush.is_alive()) {
+    bool is_particle_alive(const flo::particle_pool& particles, int i,
+            const flo::dimensions& bounds, int max_particle_history, int dead_particle_area_sz) {
+        if (particles.is_stroke_done(i)) {
+            FLO_PROFILE_COUNT("killed.stroke_done", 1);
             return false;
         }
-        if (!flo::in_bounds(p.history.back(), bounds)) {
+        if (!flo::in_bounds(particles.position(i), bounds)) {
+            FLO_PROFILE_COUNT("killed.out_of_bounds", 1);
             return false;
         }
         
-        if (p.history.size() == max_particle_history) {
-            auto points = p.history | r::to<std::vector>();
-            auto hull_dim = flo::convex_hull_bounds(points);
+        auto history = particles.history(i);
+        if (static_cast<int>(history.size()) == max_particle_history) {
+            auto hull_dim = flo::convex_hull_bounds(history);
             if (hull_dim.wd < dead_particle_area_sz && hull_dim.hgt <dead_particle_area_sz) {
+                FLO_PROFILE_COUNT("killed.stalled", 1);
                 return false;
             }
         }
@@ -44,18 +52,19 @@ namespace {
     }
 
     flo::point random_blank_loc(const flo::canvas& canv) {
-        auto blank_locs = canv.blank_locs();
-        if (blank_locs.empty()) {
+        auto num_blank_locs = canv.num_blank_locs();
+        if (num_blank_locs == 0) {
             return random_loc(canv.bounds());
         }
-        auto index = flo::rand_number(0, blank_locs.size() - 1);
-        return flo::to_point(blank_locs.at(index));
+        auto index = flo::rand_number(0, num_blank_locs - 1);
+        return flo::to_point(canv.blank_loc(index));
     }
 
-    paint_particle random_paint_particle(
+    void add_random_paint_particle(
+            flo::particle_pool& particles,
             const flo::canvas& canv,
             const flo::brush_params& params,
-            const std::vector<int> palette,
+            const std::vector<int>& palette,
             bool populate_white_space, double elapsed, 
             std::optional<double> total_time) {
 
@@ -65,30 +74,25 @@ namespace {
             random_blank_loc(canv) :
             random_loc(dim);
 
-        auto brush = flo::brush(
-            params,
-            flo::make_one_color_paint(
-                canv.palette_size(), flo::random_item(palette), 1.0
-            )
-        );
+        auto color = flo::random_item(palette);
+
+        std::optional<double> lifespan;
+        if (params.stroke_lifetime) {
+            lifespan = flo::normal_rand(params.stroke_lifetime->mean, params.stroke_lifetime->stddev);
+        }
 
         // if the brush has a ramp out period that extends beyond the known
         // duration of the simulation, truncate the brush's lifespan so that
         // it ends when the simulation ends.
 
-        if (brush.lifespan() && total_time) {
-            if (elapsed + *brush.lifespan() > *total_time) {
-                brush.set_lifespan(*total_time - elapsed);
+        if (lifespan && total_time) {
+            if (elapsed + *lifespan > *total_time) {
+                lifespan = *total_time - elapsed;
             }
         }
 
-        paint_particle p = {
-            0.0,
-            brush,
-            {}
-        };
-        p.history.push_back( rand_loc );
-        return p;
+        int i = particles.add(rand_loc, lifespan);
+        particles.paint(i) = flo::make_one_color_paint(canv.palette_size(), color, 1.0);
     }
 
     double pcnt_done(const flo::canvas& canv, int iters, const flo::flowbee_params& params) {
@@ -124,36 +128,45 @@ namespace {
         }
     }
 
-    void apply_laplacian_diffusion(flo::canvas& canvas, double diffusion_rate) {
-        using namespace flo;
-
-        auto dims = canvas.bounds();
-
-        auto new_cells = canvas;
+    void write_output(const flo::canvas& canvas, const flo::output_params& output) {
+        auto img = flo::canvas_to_image(
+            canvas, output.alpha_threshold, output.canvas_color, output.num_threads
+        );
+        FLO_PROFILE_SCOPE("write_image");
+        flo::img_to_file(output.filename, img, output.png_level, output.num_threads);
+    }
 
-        for (int y = 1; y < dims.hgt - 1; ++y) {
-            for (int x = 1; x < dims.wd - 1; ++x) {
-                // Compute the Laplacian: sum of neighbors minus 4 * center
-                flo::paint_mixture laplacian =
-                    canvas[x + 1, y] + canvas[x - 1, y] +
-                    canvas[x, y + 1] + canvas[x, y - 1] -
-                    4.0 * canvas[x, y];
+    void display_footprint_cache_stats() {
+        auto stats = flo::brush_footprints().stats();
+        std::println("    footprint cache: {} hits, {} misses, {} evictions, {:.1f} MB",
+            stats.hits, stats.misses, stats.evictions,
+            static_cast<double>(stats.bytes) / (1024.0 * 1024.0)
+        );
+        FLO_PROFILE_COUNT("footprint_cache.hits", stats.hits);
+        FLO_PROFILE_COUNT("footprint_cache.misses", stats.misses);
+        FLO_PROFILE_COUNT("footprint_cache.evictions", stats.evictions);
+    }
 
-                // Diffuse paint based on the Laplacian (scaled by diffusion rate)
-                new_cells[x, y] = canvas[x, y] + diffusion_rate * laplacian;
-            }
+    void display_paging_stats(const flo::canvas& canvas) {
+        auto stats = canvas.paging_stats();
+        if (!stats) {
+            return;
         }
-
-        canvas = std::move(new_cells);
+        std::println("    canvas paging: {} tiles paged in, {} written back, {} of {} resident",
+            stats->misses, stats->write_backs, stats->resident, stats->capacity
+        );
+        FLO_PROFILE_COUNT("canvas_paging.hits", stats->hits);
+        FLO_PROFILE_COUNT("canvas_paging.misses", stats->misses);
+        FLO_PROFILE_COUNT("canvas_paging.write_backs", stats->write_backs);
     }
 
     flo::point position_delta(
             const flo::point& loc, const flo::vector_field& flow, double delta_t,
-            const std::optional<flo::jitter_params>& jitter) {
+            const std::optional<flo::jitter_params>& jitter, flo::rng_stream& rng) {
         flo::point velocity = vector_from_field(flow, loc);
         if (jitter) {
             auto flow_theta = std::atan2(velocity.y, velocity.x);
-            auto jitter_theta = flo::normal_rand(0.0, jitter->stddev);
+            auto jitter_theta = rng.normal(0.0, jitter->stddev);
             auto theta = flow_theta + jitter->weight * jitter_theta;
             velocity = {
                 std::cos(theta),
@@ -163,12 +176,137 @@ namespace {
         return delta_t * velocity;
     }
 
-    int flowbee_layer(
-        flo::canvas& canvas, const flo::vector_field& flow, const flo::flowbee_params& params) {
+    // particles whose brushes cannot touch the same pixels are painted concurrently. The
+    // canvas is divided into square tiles at least as wide as the largest brush footprint
+    // and the tiles are visited in four phases by the parity of their column and row, so
+    // particles painted during the same phase are always separated by a full tile. Within
+    // a tile particles are painted in index order, which keeps the result deterministic
+    // regardless of how tiles are distributed over threads.
+
+    class tile_schedule {
+        int tile_sz_;
+        int cols_;
+        int rows_;
+        std::vector<std::vector<int>> tiles_;
+        std::array<std::vector<int>, 4> phases_;
+
+    public:
+        tile_schedule(const flo::dimensions& dim, double max_brush_radius) :
+                tile_sz_(2 * (static_cast<int>(std::ceil(max_brush_radius)) + 1)),
+                cols_((dim.wd + tile_sz_ - 1) / tile_sz_),
+                rows_((dim.hgt + tile_sz_ - 1) / tile_sz_),
+                tiles_(cols_ * rows_) {
+        }
+
+        void assign(const flo::particle_pool& particles) {
+            for (auto& tile : tiles_) {
+                tile.clear();
+            }
+            for (auto& phase : phases_) {
+                phase.clear();
+            }
+            for (int index = 0; index < particles.size(); ++index) {
+                auto loc = flo::to_coords(particles.position(index));
+                int col = std::clamp(loc.x / tile_sz_, 0, cols_ - 1);
+                int row = std::clamp(loc.y / tile_sz_, 0, rows_ - 1);
+                int tile = row * cols_ + col;
+                if (tiles_[tile].empty()) {
+                    phases_[2 * (row % 2) + (col % 2)].push_back(tile);
+                }
+                tiles_[tile].push_back(index);
+            }
+        }
+
+        const std::vector<int>& phase(int i) const {
+            return phases_[i];
+        }
+
+        const std::vector<int>& particles_in(int tile) const {
+            return tiles_[tile];
+        }
+    };
+
+    void apply_brushes_in_parallel(flo::canvas& canvas, flo::particle_pool& particles,
+            const flo::brush_params& brush, tile_schedule& schedule, flo::thread_pool& pool) {
+        // changes to the set of blank cells are logged per tile and replayed in tile order
+        // so that the set, which white space is sampled from, is the same on every run.
+        std::vector<std::vector<int>> blank_updates;
+        schedule.assign(particles);
+        for (int phase = 0; phase < 4; ++phase) {
+            const auto& tiles = schedule.phase(phase);
+            blank_updates.resize(std::max(blank_updates.size(), tiles.size()));
+            pool.parallel_for(static_cast<int>(tiles.size()),
+                [&](int i) {
+                    flo::blank_cell_set::deferral deferral(blank_updates[i]);
+                    for (int index : schedule.particles_in(tiles[i])) {
+                        particles.apply_brush(index, canvas, brush);
+                    }
+                }
+            );
+            for (auto& log : blank_updates | rv::take(tiles.size())) {
+                canvas.apply_blank_updates(log);
+                log.clear();
+            }
+        }
+    }
+
+    // on a paged canvas particles are painted one tile of the canvas at a time, visiting
+    // rows of tiles in alternating directions so that consecutive tiles are adjacent,
+    // which keeps the tiles being painted resident. Within a tile particles are painted
+    // in index order.
+    void order_by_tile(const flo::particle_pool& particles, const flo::dimensions& dim,
+            std::vector<int>& order) {
+        constexpr int k_tile_size = flo::tile_store::k_tile_size;
+        int cols = (dim.wd + k_tile_size - 1) / k_tile_size;
+        int rows = (dim.hgt + k_tile_size - 1) / k_tile_size;
+        auto tile_index = [&](int i) {
+            auto loc = flo::to_coords(particles.position(i));
+            int col = std::clamp(loc.x / k_tile_size, 0, cols - 1);
+            int row = std::clamp(loc.y / k_tile_size, 0, rows - 1);
+            return row * cols + ((row % 2) ? cols - 1 - col : col);
+        };
+        order.clear();
+        for (int i = 0; i < particles.size(); ++i) {
+            order.push_back(i);
+        }
+        r::stable_sort(order, {}, tile_index);
+    }
+
+    // a layer's field is either one the caller has built or a definition, which is
+    // evaluated on a worker thread while the layer before it is painted and freed once its
+    // own layer is done, so no more than two fields are held at a time.
+    struct layer_ref {
+        const flo::vector_field* flow;
+        const flo::deferred_field* deferred;
+        const flo::flowbee_params& params;
+    };
+
+    flo::dimensions layer_dimensions(const layer_ref& layer) {
+        return layer.deferred ? layer.deferred->dim : layer.flow->x.bounds();
+    }
+
+    std::future<flo::vector_field> start_building_field(const layer_ref& layer) {
+        if (!layer.deferred) {
+            return {};
+        }
+        return std::async(std::launch::async,
+            [&field = *layer.deferred]() {
+                FLO_PROFILE_SCOPE("field_construction");
+                return flo::evaluate(field);
+            }
+        );
+    }
+
+    // runs a layer from where progress says it stands. If particles are given they are
+    // those of a resumed render; otherwise the layer starts with fresh ones.
+    int flowbee_layer(flo::canvas& canvas, const flo::vector_field& flow,
+            const flo::flowbee_params& params, flo::render_progress& progress,
+            std::optional<flo::particle_pool>& resumed_particles,
+            const flo::checkpoint_params& checkpoints, std::optional<flo::frame_writer>& frames) {
 
         auto dim = canvas.bounds();
-        int iters = 0;
-        double elapsed = 0.0;
+        int iters = progress.iters;
+        double elapsed = progress.elapsed;
 
         auto palette = params.palette_subset.empty() ?
             rv::iota(0, canvas.palette_size()) | r::to<std::vector>() :
@@ -179,57 +317,184 @@ namespace {
             total_time = params.termination_criterion * params.delta_t;
         }
 
-        std::vector<paint_particle> particles = rv::iota(0, params.num_particles) | rv::transform(
-            [&](auto)->paint_particle {
-                return random_paint_particle(canvas, params.brush, palette, false, elapsed, total_time);
+        flo::particle_pool particles(params.max_particle_history);
+        if (resumed_particles) {
+            if (resumed_particles->history_capacity() != particles.history_capacity()) {
+                throw std::runtime_error("checkpoint does not match the particles of the input");
+            }
+            particles = std::move(*resumed_particles);
+            resumed_particles.reset();
+            std::println("    resuming at iteration {}", iters);
+        } else {
+            for (int i = 0; i < params.num_particles; ++i) {
+                add_random_paint_particle(
+                    particles, canvas, params.brush, palette, false, elapsed, total_time
+                );
             }
-        ) | r::to<std::vector>();
+        }
+
+        flo::thread_pool pool(params.num_threads);
+        tile_schedule schedule(dim, std::max(params.brush.radius, 1.0));
+        flo::diffusion_engine diffusion;
+        std::vector<int> paint_order;
 
         while (!is_done(canvas, iters, params)) {
 
             display_progress(iters, canvas, params);
+            FLO_PROFILE_COUNT("steps", 1);
+
+            {
+                FLO_PROFILE_SCOPE("brush_application");
+                if (canvas.is_paged()) {
+                    // a paged canvas is painted from one thread.
+                    order_by_tile(particles, dim, paint_order);
+                    for (int i : paint_order) {
+                        particles.apply_brush(i, canvas, params.brush);
+                    }
+                } else if (pool.num_threads() > 1) {
+                    apply_brushes_in_parallel(canvas, particles, params.brush, schedule, pool);
+                } else {
+                    for (int i = 0; i < particles.size(); ++i) {
+                        particles.apply_brush(i, canvas, params.brush);
+                    }
+                }
+            }
 
-            for (auto& p : particles) {
-                auto loc = p.history.back();
+            {
+                FLO_PROFILE_SCOPE("particle_stepping");
+                // each particle draws its jitter from its own stream, so particles step
+                // independently.
+                int num_blocks = (particles.size() + k_step_block_size - 1) / k_step_block_size;
+                pool.parallel_for(num_blocks,
+                    [&](int block) {
+                        int end = std::min((block + 1) * k_step_block_size, particles.size());
+                        for (int i = block * k_step_block_size; i < end; ++i) {
+                            auto loc = particles.position(i);
+                            particles.elapsed(i) += params.delta_t;
+                            particles.push_position(i, loc + position_delta(
+                                loc, flow, params.delta_t, params.jitter, particles.rng(i)
+                            ));
+                        }
+                    }
+                );
+            }
 
-                p.brush.apply(canvas, loc, { params.delta_t, p.elapsed });
-                p.elapsed += params.delta_t;
-                
-                loc = loc + position_delta(loc, flow, params.delta_t, params.jitter);
-                p.history.push_back(loc);
-                if (p.history.size() > params.max_particle_history) {
-                    p.history.pop_front();
-                }
+            {
+                FLO_PROFILE_SCOPE("survivor_filtering");
+                particles.retain_if(
+                    [&](int i) {
+                        return is_particle_alive(
+                            particles, i, dim, params.max_particle_history,
+                            params.dead_particle_area_sz
+                        );
+                    }
+                );
             }
 
-            particles = particles | rv::filter(
-                [&](const auto& p) {
-                    auto alive = is_particle_alive(
-                        p, dim, params.max_particle_history, params.dead_particle_area_sz
+            {
+                FLO_PROFILE_SCOPE("respawn");
+                while (particles.size() < params.num_particles) {
+                    add_random_paint_particle(
+                        particles, canvas, params.brush, palette, params.populate_white_space,
+                        elapsed, total_time
                     );
-                    return alive;
                 }
-            ) | r::to<std::vector>();
-
-            while (particles.size() < params.num_particles) {
-                particles.push_back(
-                    random_paint_particle(
-                        canvas, params.brush, palette, params.populate_white_space,
-                        elapsed, total_time
-                    )
-                );
             }
 
             if (params.diffusion_rate && *params.diffusion_rate > 0.0) {
-                apply_laplacian_diffusion(canvas, *params.diffusion_rate);
+                FLO_PROFILE_SCOPE("diffusion");
+                diffusion.apply(canvas, *params.diffusion_rate, pool);
             }
 
             ++iters;
             elapsed += params.delta_t;
+
+            int total_iters = progress.prior_iters + iters;
+            if (frames && total_iters % frames->every() == 0) {
+                frames->take_frame(canvas, total_iters);
+            }
+            if (checkpoints.every > 0 && total_iters % checkpoints.every == 0) {
+                FLO_PROFILE_SCOPE("checkpoint");
+                progress.iters = iters;
+                progress.elapsed = elapsed;
+                flo::write_checkpoint(checkpoints.filename, progress, canvas, particles);
+            }
         }
         std::println("");
         return iters;
     }
+
+    void render_layers(const flo::output_params& output,
+            const std::vector<flo::rgb_color>& palette, std::span<const layer_ref> layers,
+            const flo::checkpoint_params& checkpoints) {
+
+        auto dim = layer_dimensions(layers.front());
+        if (output.canvas_paging) {
+            if (output.frame_every > 0) {
+                throw std::runtime_error("time-lapse frames need a canvas held in memory");
+            }
+            auto diffuses = [](const auto& layer) {
+                return layer.params.diffusion_rate.value_or(0.0) > 0.0;
+            };
+            if (r::any_of(layers, diffuses)) {
+                throw std::runtime_error("diffusion needs a canvas held in memory");
+            }
+        }
+        auto canvas = output.canvas_paging ?
+            flo::canvas(palette, dim, *output.canvas_paging) :
+            flo::canvas(palette, dim, output.canvas_layout);
+        flo::render_progress progress{ 0, 0, 0.0, 0 };
+        std::optional<flo::particle_pool> resumed_particles;
+        if (!checkpoints.resume_from.empty()) {
+            resumed_particles.emplace();
+            progress = flo::read_checkpoint(checkpoints.resume_from, canvas, *resumed_particles);
+            if (progress.layer >= static_cast<int>(layers.size())) {
+                throw std::runtime_error("checkpoint does not match the layers of the input");
+            }
+        }
+
+        std::optional<flo::frame_writer> frames;
+        if (output.frame_every > 0) {
+            frames.emplace(output, canvas);
+        }
+
+        int num_layers = static_cast<int>(layers.size());
+        auto next_field = start_building_field(layers[progress.layer]);
+        for (int layer_index = progress.layer; layer_index < num_layers; ++layer_index) {
+            if (num_layers > 1) {
+                std::println(" - layer {} -", layer_index + 1);
+            }
+            progress.layer = layer_index;
+            const auto& layer = layers[layer_index];
+            std::optional<flo::vector_field> built_field;
+            if (layer.deferred) {
+                FLO_PROFILE_SCOPE("field_wait");
+                built_field = next_field.get();
+            }
+            if (layer_index + 1 < num_layers) {
+                next_field = start_building_field(layers[layer_index + 1]);
+            }
+            const auto& flow = built_field ? *built_field : *layer.flow;
+            progress.prior_iters += flowbee_layer(
+                canvas, flow, layer.params, progress, resumed_particles, checkpoints, frames
+            );
+            progress.iters = 0;
+            progress.elapsed = 0.0;
+        }
+
+        write_output(canvas, output);
+        if (frames) {
+            frames->finish();
+        }
+
+        if (num_layers > 1) {
+            std::println("\ncomplete.\n(after {} iterations)", progress.prior_iters);
+        } else {
+            std::println("\n    complete.\n    {} iterations", progress.prior_iters);
+        }
+        display_footprint_cache_stats();
+        display_paging_stats(canvas);
+    }
 }
 
 flo::flowbee_params::flowbee_params(const brush_params& b, int iters, int n_particles) :
@@ -240,7 +505,8 @@ flo::flowbee_params::flowbee_params(const brush_params& b, int iters, int n_part
     delta_t(1.0),
     termination_criterion(iters),
     num_particles(n_particles),
-    populate_white_space(true)
+    populate_white_space(true),
+    num_threads(1)
 {
 }
 
@@ -252,45 +518,20 @@ flo::flowbee_params::flowbee_params(const brush_params& b, int n_particles) :
 
 void flo::do_flowbee(
         const output_params& output, const std::vector<flo::rgb_color>& palette,
-        const vector_field& flow, const flowbee_params& params) {
-
-    flo::canvas canvas(palette, flow.x.bounds());
-    auto iters = flowbee_layer(canvas, flow, params);
-
-    flo::img_to_file(
-        output.filename,
-        flo::canvas_to_image(
-            canvas, output.alpha_threshold, output.canvas_color
-        )
-    );
-
-    std::println("\n    complete.\n    {} iterations", iters);
+        const vector_field& flow, const flowbee_params& params,
+        const checkpoint_params& checkpoints) {
+    layer_ref layer{ &flow, nullptr, params };
+    render_layers(output, palette, std::span(&layer, 1), checkpoints);
 }
 
 void flo::do_flowbee(
         const output_params& output,
-        const std::vector<flo::rgb_color>& palette, const std::vector<layer_params>& layers) {
-
-    if (layers.size() == 1) {
-        const auto& layer = layers.front();
-        do_flowbee(output, palette, layer.flow, layer.params);
-        return;
-    }
-
-    flo::canvas canvas(palette, layers.front().flow.x.bounds());
-    int iters = 0;
-    for (const auto& [layer_index,layer] : rv::enumerate(layers)) {
-        std::println(" - layer {} -", layer_index + 1);
-        iters += flowbee_layer(canvas, layer.flow, layer.params);
-    }
-
-    flo::img_to_file(
-        output.filename,
-        flo::canvas_to_image(
-            canvas, output.alpha_threshold, output.canvas_color
-        )
-    );
-
-    std::println("\ncomplete.\n(after {} iterations)", iters);
+        const std::vector<flo::rgb_color>& palette, const std::vector<layer_params>& layers,
+        const checkpoint_params& checkpoints) {
+    auto refs = layers |
+        rv::transform(
+            [](const auto& layer) { return layer_ref{ nullptr, &layer.flow, layer.params }; }
+        ) |
+        r::to<std::vector>();
+    render_layers(output, palette, refs, checkpoints);
 }
-
@@ -3,6 +3,7 @@
 #include "types.hpp"
 #include "brush.hpp"
 #include "canvas.hpp"
+#include "checkpoint.hpp"
 #include "vector_field.hpp"
 #include <variant>
 #include <optional>
@@ -14,6 +15,12 @@ namespace flo {
         std::string filename;
         rgb_color canvas_color;
         double alpha_threshold;
+        storage_layout canvas_layout;
+        int num_threads;
+        int png_level;
+        int frame_every;
+        std::string frame_filename;
+        std::optional<paging_params> canvas_paging;
     };
 
     struct jitter_params {
@@ -33,12 +40,13 @@ namespace flo {
         std::vector<int> palette_subset; 
         std::optional<double> diffusion_rate;
         std::optional<jitter_params> jitter;
+        int num_threads;
         flowbee_params(const brush_params& b, int iters, int n_particles);
         flowbee_params(const brush_params& b = {}, int n_particles = 0);
     };
 
     struct layer_params {
-        vector_field flow;
+        deferred_field flow;
         flowbee_params params;
     };
 
@@ -46,13 +54,15 @@ namespace flo {
         const output_params& output,
         const std::vector<flo::rgb_color>& palette,
         const vector_field& flow,
-        const flowbee_params& params
+        const flowbee_params& params,
+        const checkpoint_params& checkpoints = {}
     );
 
     void do_flowbee(
         const output_params& output,
         const std::vector<flo::rgb_color>& palette,
-        const std::vector<layer_params>& layers
+        const std::vector<layer_params>& layers,
+        const checkpoint_params& checkpoints = {}
     );
 
 }
\ No newline at end of file
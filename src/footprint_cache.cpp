@@ -0,0 +1,174 @@
+#include "footprint_cache.hpp"
+#include "brush.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <boost/functional/hash.hpp>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+    constexpr double k_bytes_per_megabyte = 1024.0 * 1024.0;
+
+    int snap(double v, double grid) {
+        return static_cast<int>(std::round(v * grid));
+    }
+
+    // pixels must be in row-major order, as brush_region_aux produces them.
+    std::shared_ptr<const flo::footprint> make_footprint(
+            const std::vector<flo::region_pixel>& pixels) {
+        flo::footprint fp{ {}, {}, { {0, 0}, {-1, -1} } };
+        if (!pixels.empty()) {
+            fp.bounds = { pixels.front().loc, pixels.front().loc };
+        }
+        fp.weights.reserve(pixels.size());
+        for (const auto& [loc, weight] : pixels) {
+            auto& bounds = fp.bounds;
+            bounds.min = { std::min(bounds.min.x, loc.x), std::min(bounds.min.y, loc.y) };
+            bounds.max = { std::max(bounds.max.x, loc.x), std::max(bounds.max.y, loc.y) };
+
+            if (fp.runs.empty() || fp.runs.back().y != loc.y || fp.runs.back().x_end != loc.x) {
+                int offset = static_cast<int>(fp.weights.size());
+                fp.runs.push_back({ loc.y, loc.x, loc.x, offset });
+            }
+            ++fp.runs.back().x_end;
+            fp.weights.push_back(weight);
+        }
+        return std::make_shared<const flo::footprint>(std::move(fp));
+    }
+}
+
+size_t flo::footprint_cache::key_hash::operator()(const key& k) const {
+    size_t seed = 0;
+    boost::hash_combine(seed, k.x);
+    boost::hash_combine(seed, k.y);
+    boost::hash_combine(seed, k.radius);
+    boost::hash_combine(seed, k.aa_level);
+    return seed;
+}
+
+flo::footprint_cache::footprint_cache(const footprint_cache_params& params) :
+        hits_(0),
+        misses_(0),
+        evictions_(0) {
+    configure(params);
+}
+
+flo::footprint_cache_params flo::footprint_cache::default_params() {
+    return {
+        .subpixel_grid = 64,
+        .max_megabytes = 256.0
+    };
+}
+
+void flo::footprint_cache::configure(const footprint_cache_params& params) {
+    if (params.subpixel_grid <= 0) {
+        throw std::invalid_argument("footprint cache subpixel grid must be positive");
+    }
+    // negated so that NaN is rejected too.
+    if (!(params.max_megabytes > 0.0)) {
+        throw std::invalid_argument("footprint cache max_megabytes must be positive");
+    }
+    params_ = params;
+    shard_budget_ = static_cast<size_t>(
+        params.max_megabytes * k_bytes_per_megabyte / k_num_shards
+    );
+    for (auto& s : shards_) {
+        std::unique_lock lock(s.mutex);
+        s.index.clear();
+        s.entries.clear();
+        s.bytes = 0;
+        s.hand = 0;
+    }
+}
+
+std::shared_ptr<const flo::footprint> flo::footprint_cache::get(
+        const point& offset, double radius, int aa_level) {
+
+    double grid = params_.subpixel_grid;
+    key k{ snap(offset.x, grid), snap(offset.y, grid), snap(radius, grid), aa_level };
+    auto& s = shards_[key_hash{}(k) % k_num_shards];
+
+    {
+        std::shared_lock lock(s.mutex);
+        auto iter = s.index.find(k);
+        if (iter != s.index.end()) {
+            auto& e = s.entries[iter->second];
+            std::atomic_ref<uint8_t>(e.referenced).store(1, std::memory_order_relaxed);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return e.value;
+        }
+    }
+
+    // footprints are computed at the snapped offset and radius, outside of the lock, so
+    // that every entry for a key is identical no matter which thread built it.
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    auto value = make_footprint(
+        detail::brush_region_aux({ k.x / grid, k.y / grid }, k.radius / grid, aa_level)
+    );
+    size_t bytes = sizeof(entry) + value->runs.capacity() * sizeof(footprint_run) +
+        value->weights.capacity() * sizeof(double);
+
+    std::unique_lock lock(s.mutex);
+    auto iter = s.index.find(k);
+    if (iter != s.index.end()) {
+        return s.entries[iter->second].value;
+    }
+    while (!s.entries.empty() && s.bytes + bytes > shard_budget_) {
+        evict_one(s);
+    }
+    s.index[k] = static_cast<int>(s.entries.size());
+    s.entries.push_back({ k, value, bytes, 1 });
+    s.bytes += bytes;
+
+    return value;
+}
+
+void flo::footprint_cache::evict_one(shard& s) {
+    // CLOCK: sweep the entries, giving recently used ones a second chance.
+    while (true) {
+        if (s.hand >= s.entries.size()) {
+            s.hand = 0;
+        }
+        auto& e = s.entries[s.hand];
+        if (!e.referenced) {
+            break;
+        }
+        e.referenced = 0;
+        ++s.hand;
+    }
+
+    auto victim = s.hand;
+    s.bytes -= s.entries[victim].bytes;
+    s.index.erase(s.entries[victim].k);
+    if (victim != s.entries.size() - 1) {
+        s.entries[victim] = std::move(s.entries.back());
+        s.index[s.entries[victim].k] = static_cast<int>(victim);
+    }
+    s.entries.pop_back();
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+flo::footprint_cache_stats flo::footprint_cache::stats() const {
+    footprint_cache_stats stats{
+        hits_.load(std::memory_order_relaxed),
+        misses_.load(std::memory_order_relaxed),
+        evictions_.load(std::memory_order_relaxed),
+        0,
+        0
+    };
+    for (const auto& s : shards_) {
+        std::shared_lock lock(s.mutex);
+        stats.entries += s.entries.size();
+        stats.bytes += s.bytes;
+    }
+    return stats;
+}
+
+flo::footprint_cache& flo::brush_footprints() {
+    static footprint_cache cache;
+    return cache;
+}
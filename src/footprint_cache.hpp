@@ -0,0 +1,117 @@
+#pragma once
+
+#include "types.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    struct region_pixel {
+        coords loc;
+        double weight;
+    };
+
+    // a horizontal run of covered pixels [x_begin, x_end) in row y. The coverage of its
+    // pixels is stored contiguously in footprint::weights starting at index weights.
+    struct footprint_run {
+        int y;
+        int x_begin;
+        int x_end;
+        int weights;
+    };
+
+    // the pixels covered by a brush dab relative to the pixel containing its center, as
+    // row-major runs, and their bounding box.
+    struct footprint {
+        std::vector<footprint_run> runs;
+        std::vector<double> weights;
+        rect bounds;
+    };
+
+    struct footprint_cache_params {
+        int subpixel_grid;
+        double max_megabytes;
+    };
+
+    struct footprint_cache_stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    // a bounded, thread-safe cache of brush footprints. Sub-pixel offsets and radii are
+    // snapped to a grid of 1/subpixel_grid pixels, so the number of distinct footprints
+    // is finite, and entries are evicted with the CLOCK policy once the cache holds
+    // max_megabytes of footprints. The cache is split into shards, each guarded by a
+    // reader/writer lock; lookups that hit only take the shared lock, so any number of
+    // threads can read concurrently. Footprints are handed out as shared pointers and
+    // remain valid after eviction for as long as a caller holds them.
+
+    class footprint_cache {
+
+        struct key {
+            int x;
+            int y;
+            int radius;
+            int aa_level;
+
+            bool operator==(const key& other) const = default;
+        };
+
+        struct key_hash {
+            size_t operator()(const key& k) const;
+        };
+
+        struct entry {
+            key k;
+            std::shared_ptr<const footprint> value;
+            size_t bytes;
+            uint8_t referenced;
+        };
+
+        struct shard {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<key, int, key_hash> index;
+            std::vector<entry> entries;
+            size_t bytes = 0;
+            size_t hand = 0;
+        };
+
+        static constexpr int k_num_shards = 16;
+
+        footprint_cache_params params_;
+        size_t shard_budget_;
+        std::array<shard, k_num_shards> shards_;
+        std::atomic<uint64_t> hits_;
+        std::atomic<uint64_t> misses_;
+        std::atomic<uint64_t> evictions_;
+
+        void evict_one(shard& s);
+
+    public:
+        footprint_cache(const footprint_cache_params& params = default_params());
+
+        static footprint_cache_params default_params();
+
+        // returns the footprint of a brush of the given radius centered at offset from the
+        // top-left corner of a pixel, where offset is in [0,1) x [0,1).
+        std::shared_ptr<const footprint> get(const point& offset, double radius, int aa_level);
+
+        // discards all cached footprints and applies new parameters. Not safe to call
+        // while other threads are using the cache.
+        void configure(const footprint_cache_params& params);
+
+        footprint_cache_stats stats() const;
+    };
+
+    footprint_cache& brush_footprints();
+}
@@ -0,0 +1,132 @@
+#include "frame_writer.hpp"
+#include "profiler.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <ranges>
+
+namespace r = std::ranges;
+namespace fs = std::filesystem;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    std::string frame_filename(const std::string& filename, int iteration) {
+        fs::path path(filename);
+        auto frame = std::format("{}_{:06}{}",
+            path.stem().string(), iteration, path.extension().string()
+        );
+        return path.replace_filename(frame).string();
+    }
+
+}
+
+flo::frame_writer::frame_writer(const output_params& output, canvas& canv) :
+        filename_(output.frame_filename),
+        every_(output.frame_every),
+        canvas_color_(output.canvas_color),
+        alpha_threshold_(output.alpha_threshold),
+        num_threads_(output.num_threads),
+        png_level_(output.png_level),
+        buffers_{
+            buffer{ canv, std::vector<uint8_t>(canv.tile_flags().size(), 0), 0, false },
+            buffer{ canv, std::vector<uint8_t>(canv.tile_flags().size(), 0), 0, false }
+        },
+        next_buffer_(0),
+        stopping_(false) {
+    canv.clear_changed_tiles();
+    thread_ = std::jthread([this]() { writer_loop(); });
+}
+
+flo::frame_writer::~frame_writer() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+}
+
+int flo::frame_writer::every() const {
+    return every_;
+}
+
+void flo::frame_writer::take_frame(canvas& canv, int iteration) {
+    FLO_PROFILE_SCOPE("take_frame");
+
+    // tiles written since the last frame are stale in both snapshots.
+    const auto& tiles = canv.tiles();
+    for (int tile_y = 0; tile_y < tiles.rows(); ++tile_y) {
+        for (int tile_x = 0; tile_x < tiles.cols(); ++tile_x) {
+            if (tiles.is_changed(tile_x, tile_y)) {
+                for (auto& buff : buffers_) {
+                    buff.stale_tiles[tile_y * tiles.cols() + tile_x] = 1;
+                }
+            }
+        }
+    }
+    canv.clear_changed_tiles();
+
+    auto& buff = buffers_[next_buffer_];
+    {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [&]() { return !buff.pending || error_; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // the writer thread does not touch a buffer that is not pending.
+    buff.snapshot.copy_tiles(canv, buff.stale_tiles);
+    r::fill(buff.stale_tiles, 0);
+    buff.iteration = iteration;
+
+    {
+        std::lock_guard lock(mutex_);
+        buff.pending = true;
+        queue_.push(next_buffer_);
+    }
+    changed_.notify_all();
+    next_buffer_ = 1 - next_buffer_;
+}
+
+void flo::frame_writer::finish() {
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [&]() { return queue_.empty() || error_; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void flo::frame_writer::writer_loop() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        changed_.wait(lock, [&]() { return !queue_.empty() || stopping_; });
+        if (queue_.empty()) {
+            return;
+        }
+        auto& buff = buffers_[queue_.front()];
+        lock.unlock();
+
+        try {
+            FLO_PROFILE_SCOPE("write_frame");
+            auto img = canvas_to_image(
+                buff.snapshot, alpha_threshold_, canvas_color_, num_threads_
+            );
+            img_to_file(frame_filename(filename_, buff.iteration), img, png_level_, num_threads_);
+        } catch (...) {
+            lock.lock();
+            error_ = std::current_exception();
+            queue_ = {};
+            buff.pending = false;
+            changed_.notify_all();
+            return;
+        }
+
+        lock.lock();
+        buff.pending = false;
+        queue_.pop();
+        changed_.notify_all();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "canvas.hpp"
+#include "flowbee.hpp"
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // writes frames of a render in progress on a background thread, every
+    // output.frame_every iterations, to files named after output.frame_filename with the
+    // iteration appended. The writer keeps two snapshots of the canvas. Taking a frame
+    // brings the snapshot not being written up to date by copying the tiles written
+    // since it was last updated, which the live canvas's changed tile flags record, so
+    // the render stalls only for that copy unless the writer is two frames behind.
+    // Frames are exported and encoded on the writer's thread in the order taken.
+
+    class frame_writer {
+        struct buffer {
+            canvas snapshot;
+            std::vector<uint8_t> stale_tiles;
+            int iteration;
+            bool pending;
+        };
+
+        std::string filename_;
+        int every_;
+        rgb_color canvas_color_;
+        double alpha_threshold_;
+        int num_threads_;
+        int png_level_;
+        std::array<buffer, 2> buffers_;
+        int next_buffer_;
+        std::queue<int> queue_;
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        bool stopping_;
+        std::exception_ptr error_;
+        std::jthread thread_;
+
+        void writer_loop();
+
+    public:
+        // the changed tile flags of canv belong to the writer from here on.
+        frame_writer(const output_params& output, canvas& canv);
+        frame_writer(const frame_writer&) = delete;
+        frame_writer& operator=(const frame_writer&) = delete;
+        ~frame_writer();
+
+        int every() const;
+
+        void take_frame(canvas& canv, int iteration);
+
+        // waits for the frames taken so far to be written. Errors from writing a frame
+        // are rethrown here or by the next take_frame().
+        void finish();
+    };
+
+}
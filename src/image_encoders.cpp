@@ -0,0 +1,546 @@
+#include "image_encoders.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr size_t k_band_bytes = 1 << 20;
+    constexpr int k_window_size = 32768;
+    constexpr int k_min_match = 3;
+    constexpr int k_max_match = 258;
+    constexpr int k_hash_bits = 15;
+    constexpr int k_max_stored_block = 65535;
+    constexpr uint32_t k_adler_base = 65521;
+
+    // the number of earlier occurrences of a position's first bytes examined for a
+    // match, by compression level.
+    constexpr std::array<int, 10> k_max_probes = { 0, 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+
+    constexpr std::array<int, 29> k_length_base = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    constexpr std::array<int, 29> k_length_extra = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    constexpr std::array<int, 30> k_distance_base = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    constexpr std::array<int, 30> k_distance_extra = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+        9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    struct huffman_code {
+        uint16_t bits;
+        uint8_t len;
+    };
+
+    uint16_t reverse_bits(uint32_t code, int len) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < len; ++i) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        return static_cast<uint16_t>(reversed);
+    }
+
+    // the fixed Huffman codes of deflate, bit-reversed because deflate packs codes from
+    // their most significant bit, and the symbols encoding each match length and
+    // distance. Distances over 256 are looked up by (distance - 1) / 128, as in zlib.
+    struct fixed_huffman {
+        std::array<huffman_code, 288> literals;
+        std::array<huffman_code, 30> distances;
+        std::array<uint8_t, k_max_match + 1> length_symbols;
+        std::array<uint8_t, 512> distance_symbols;
+
+        fixed_huffman() {
+            for (int sym = 0; sym < 288; ++sym) {
+                auto [code, len] =
+                    (sym < 144) ? std::pair{ 0x30 + sym, 8 } :
+                    (sym < 256) ? std::pair{ 0x190 + sym - 144, 9 } :
+                    (sym < 280) ? std::pair{ sym - 256, 7 } :
+                    std::pair{ 0xc0 + sym - 280, 8 };
+                literals[sym] = { reverse_bits(code, len), static_cast<uint8_t>(len) };
+            }
+            for (int sym = 0; sym < 30; ++sym) {
+                distances[sym] = { reverse_bits(sym, 5), 5 };
+                for (int dist = k_distance_base[sym];
+                        dist < k_distance_base[sym] + (1 << k_distance_extra[sym]); ++dist) {
+                    distance_symbols[dist <= 256 ? dist - 1 : 256 + ((dist - 1) >> 7)] =
+                        static_cast<uint8_t>(sym);
+                }
+            }
+            for (int sym = 0; sym < 29; ++sym) {
+                for (int len = k_length_base[sym];
+                        len < k_length_base[sym] + (1 << k_length_extra[sym]) && len <= k_max_match;
+                        ++len) {
+                    length_symbols[len] = static_cast<uint8_t>(sym);
+                }
+            }
+            // 258 has a symbol of its own rather than being the last length of 284's range.
+            length_symbols[k_max_match] = 28;
+        }
+
+        int distance_symbol(int dist) const {
+            return distance_symbols[dist <= 256 ? dist - 1 : 256 + ((dist - 1) >> 7)];
+        }
+    };
+
+    const fixed_huffman& fixed_codes() {
+        static const fixed_huffman codes;
+        return codes;
+    }
+
+    // packs codes into bytes from the least significant bit up, as deflate requires.
+    class bit_writer {
+        std::vector<uint8_t>& out_;
+        uint64_t bits_;
+        int count_;
+
+    public:
+        explicit bit_writer(std::vector<uint8_t>& out) : out_(out), bits_(0), count_(0) {}
+
+        void put(uint32_t value, int len) {
+            bits_ |= static_cast<uint64_t>(value) << count_;
+            count_ += len;
+            if (count_ >= 32) {
+                for (int i = 0; i < 4; ++i) {
+                    out_.push_back(static_cast<uint8_t>(bits_ >> (8 * i)));
+                }
+                bits_ >>= 32;
+                count_ -= 32;
+            }
+        }
+
+        void put(const huffman_code& code) {
+            put(code.bits, code.len);
+        }
+
+        void align() {
+            for (; count_ > 0; count_ -= 8) {
+                out_.push_back(static_cast<uint8_t>(bits_));
+                bits_ >>= 8;
+            }
+            bits_ = 0;
+            count_ = 0;
+        }
+    };
+
+    uint32_t hash3(const uint8_t* p) {
+        uint32_t bytes = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (bytes * 0x9e3779b1u) >> (32 - k_hash_bits);
+    }
+
+    int match_length(const uint8_t* a, const uint8_t* b, int max_len) {
+        int len = 0;
+        if constexpr (std::endian::native == std::endian::little) {
+            for (; len + 8 <= max_len; len += 8) {
+                uint64_t x;
+                uint64_t y;
+                std::memcpy(&x, a + len, 8);
+                std::memcpy(&y, b + len, 8);
+                if (x != y) {
+                    return len + std::countr_zero(x ^ y) / 8;
+                }
+            }
+        }
+        while (len < max_len && a[len] == b[len]) {
+            ++len;
+        }
+        return len;
+    }
+
+    // an empty stored block, which brings the stream to a byte boundary so that more
+    // compressed data can be appended to it.
+    void sync_flush(bit_writer& bits, std::vector<uint8_t>& out) {
+        bits.put(0, 3);
+        bits.align();
+        out.insert(out.end(), { 0x00, 0x00, 0xff, 0xff });
+    }
+
+    // greedy LZ77 matching over a hash chain, coded with the fixed Huffman codes, as a
+    // single non-final block.
+    void deflate_band(std::span<const uint8_t> data, int max_probes, std::vector<uint8_t>& out) {
+        const auto& codes = fixed_codes();
+        int n = static_cast<int>(data.size());
+        std::vector<int> head(1 << k_hash_bits, -1);
+        std::vector<int> prev(n);
+        auto insert = [&](int i) {
+            uint32_t h = hash3(&data[i]);
+            prev[i] = head[h];
+            head[h] = i;
+            return prev[i];
+        };
+
+        bit_writer bits(out);
+        bits.put(0b010, 3);
+        int i = 0;
+        while (i < n) {
+            int best_len = 0;
+            int best_dist = 0;
+            if (i + k_min_match <= n) {
+                int max_len = std::min(k_max_match, n - i);
+                int candidate = insert(i);
+                for (int probes = max_probes;
+                        probes > 0 && candidate >= 0 && i - candidate <= k_window_size; --probes) {
+                    int len = match_length(&data[candidate], &data[i], max_len);
+                    if (len > best_len) {
+                        best_len = len;
+                        best_dist = i - candidate;
+                        if (len == max_len) {
+                            break;
+                        }
+                    }
+                    candidate = prev[candidate];
+                }
+            }
+
+            if (best_len < k_min_match) {
+                bits.put(codes.literals[data[i]]);
+                ++i;
+                continue;
+            }
+
+            int len_sym = codes.length_symbols[best_len];
+            bits.put(codes.literals[257 + len_sym]);
+            bits.put(best_len - k_length_base[len_sym], k_length_extra[len_sym]);
+            int dist_sym = codes.distance_symbol(best_dist);
+            bits.put(codes.distances[dist_sym]);
+            bits.put(best_dist - k_distance_base[dist_sym], k_distance_extra[dist_sym]);
+
+            // with a single probe only match starts are hashed, which is much faster.
+            if (max_probes > 1) {
+                for (int j = i + 1; j < i + best_len && j + k_min_match <= n; ++j) {
+                    insert(j);
+                }
+            }
+            i += best_len;
+        }
+        bits.put(codes.literals[256]);
+        sync_flush(bits, out);
+    }
+
+    void store_band(std::span<const uint8_t> data, std::vector<uint8_t>& out) {
+        for (size_t offset = 0; offset < data.size(); offset += k_max_stored_block) {
+            auto len = static_cast<uint16_t>(
+                std::min<size_t>(k_max_stored_block, data.size() - offset)
+            );
+            auto complement = static_cast<uint16_t>(~len);
+            out.insert(out.end(), {
+                0x00,
+                static_cast<uint8_t>(len), static_cast<uint8_t>(len >> 8),
+                static_cast<uint8_t>(complement), static_cast<uint8_t>(complement >> 8)
+            });
+            out.insert(out.end(), data.begin() + offset, data.begin() + offset + len);
+        }
+    }
+
+    uint32_t adler32(std::span<const uint8_t> data) {
+        uint32_t a = 1;
+        uint32_t b = 0;
+        // 5552 bytes is the most that can be summed before b can overflow.
+        for (size_t i = 0; i < data.size();) {
+            size_t end = std::min(data.size(), i + 5552);
+            for (; i < end; ++i) {
+                a += data[i];
+                b += a;
+            }
+            a %= k_adler_base;
+            b %= k_adler_base;
+        }
+        return (b << 16) | a;
+    }
+
+    // the checksum of two sequences concatenated, from their checksums and the length of
+    // the second, as in zlib's adler32_combine.
+    uint32_t adler32_combine(uint32_t adler_1, uint32_t adler_2, size_t len_2) {
+        auto rem = static_cast<uint32_t>(len_2 % k_adler_base);
+        uint32_t sum_1 = adler_1 & 0xffff;
+        auto sum_2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum_1) % k_adler_base);
+        sum_1 += (adler_2 & 0xffff) + k_adler_base - 1;
+        sum_2 += (adler_1 >> 16) + (adler_2 >> 16) + k_adler_base - rem;
+        if (sum_1 >= k_adler_base) {
+            sum_1 -= k_adler_base;
+        }
+        if (sum_1 >= k_adler_base) {
+            sum_1 -= k_adler_base;
+        }
+        if (sum_2 >= 2 * k_adler_base) {
+            sum_2 -= 2 * k_adler_base;
+        }
+        if (sum_2 >= k_adler_base) {
+            sum_2 -= k_adler_base;
+        }
+        return sum_1 | (sum_2 << 16);
+    }
+
+    uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0) {
+        static const auto table = []() {
+            std::array<uint32_t, 256> t;
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (uint8_t byte : data) {
+            crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void put_u32_be(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    std::vector<uint8_t> png_chunk(std::string_view type, std::span<const uint8_t> data) {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        put_u32_be(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type.begin(), type.end());
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        put_u32_be(chunk, crc32(std::span(chunk).subspan(4)));
+        return chunk;
+    }
+
+    uint8_t paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a);
+        int pb = std::abs(p - b);
+        int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) {
+            return static_cast<uint8_t>(a);
+        }
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+    // filters a row of RGBA pixels with one of the five png filters, given the row above,
+    // returning the sum of the absolute values of the output.
+    template<int Type>
+    uint64_t apply_filter(const uint8_t* row, const uint8_t* prev, int len, uint8_t* out) {
+        uint64_t score = 0;
+        for (int i = 0; i < len; ++i) {
+            int a = (i >= 4) ? row[i - 4] : 0;
+            int b = prev[i];
+            int c = (i >= 4) ? prev[i - 4] : 0;
+            uint8_t predicted = 0;
+            if constexpr (Type == 1) {
+                predicted = static_cast<uint8_t>(a);
+            } else if constexpr (Type == 2) {
+                predicted = static_cast<uint8_t>(b);
+            } else if constexpr (Type == 3) {
+                predicted = static_cast<uint8_t>((a + b) / 2);
+            } else if constexpr (Type == 4) {
+                predicted = paeth(a, b, c);
+            }
+            auto filtered = static_cast<uint8_t>(row[i] - predicted);
+            out[i] = filtered;
+            score += std::abs(static_cast<int8_t>(filtered));
+        }
+        return score;
+    }
+
+    // the png filter applied to every row at a level: none when storing uncompressed, and
+    // up, the cheapest that helps much, at the fastest level. Higher levels choose the
+    // filter of each row.
+    constexpr int k_adaptive_filter = -1;
+
+    int row_filter(int level) {
+        return (level == 0) ? 0 : (level == 1) ? 2 : k_adaptive_filter;
+    }
+
+    // writes the filter type and the filtered bytes of a row. An adaptive filter is the
+    // one whose output has the least sum of absolute values, the usual heuristic. prev
+    // is a row of zeros for the first row of the image.
+    void filter_row(const uint8_t* row, const uint8_t* prev, int len, int filter,
+            uint8_t* out, std::vector<uint8_t>& scratch) {
+        if (filter == 2) {
+            out[0] = 2;
+            apply_filter<2>(row, prev, len, out + 1);
+            return;
+        }
+        out[0] = 0;
+        uint64_t best_score = apply_filter<0>(row, prev, len, out + 1);
+        if (filter != k_adaptive_filter) {
+            return;
+        }
+        scratch.resize(len);
+        auto try_filter = [&]<int Type>() {
+            uint64_t score = apply_filter<Type>(row, prev, len, scratch.data());
+            if (score < best_score) {
+                best_score = score;
+                out[0] = Type;
+                std::copy_n(scratch.begin(), len, out + 1);
+            }
+        };
+        try_filter.template operator()<1>();
+        try_filter.template operator()<2>();
+        try_filter.template operator()<3>();
+        try_filter.template operator()<4>();
+    }
+
+    uint8_t zlib_flags(int level) {
+        constexpr uint8_t k_cmf = 0x78;
+        int flevel = (level <= 1) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+        int flags = flevel << 6;
+        return static_cast<uint8_t>(flags + (31 - (k_cmf * 256 + flags) % 31) % 31);
+    }
+
+}
+
+std::vector<uint8_t> flo::encode_png(const image& img, int level, int num_threads) {
+    if (level < 0 || level > 9) {
+        throw std::invalid_argument("png compression level must be from 0 to 9");
+    }
+    int wd = img.cols();
+    int hgt = img.rows();
+    if (wd <= 0 || hgt <= 0) {
+        throw std::invalid_argument("cannot encode an empty image");
+    }
+
+    const auto* pixels = static_cast<const uint8_t*>(img.data());
+    int row_bytes = 4 * wd;
+    int band_rows = std::max(1, static_cast<int>(k_band_bytes / (row_bytes + 1)));
+    int num_bands = (hgt + band_rows - 1) / band_rows;
+
+    std::vector<std::vector<uint8_t>> chunks(num_bands);
+    std::vector<uint32_t> adlers(num_bands);
+    std::vector<size_t> lengths(num_bands);
+    thread_pool pool(num_threads);
+    int filter = row_filter(level);
+    pool.parallel_for(num_bands,
+        [&](int band) {
+            int y_begin = band * band_rows;
+            int y_end = std::min(hgt, y_begin + band_rows);
+            std::vector<uint8_t> filtered(static_cast<size_t>(y_end - y_begin) * (row_bytes + 1));
+            std::vector<uint8_t> scratch;
+            std::vector<uint8_t> zeros(row_bytes, 0);
+            for (int y = y_begin; y < y_end; ++y) {
+                const uint8_t* row = pixels + static_cast<size_t>(y) * row_bytes;
+                filter_row(row, (y > 0) ? row - row_bytes : zeros.data(), row_bytes, filter,
+                    &filtered[static_cast<size_t>(y - y_begin) * (row_bytes + 1)], scratch);
+            }
+            adlers[band] = adler32(filtered);
+            lengths[band] = filtered.size();
+
+            std::vector<uint8_t> data;
+            if (band == 0) {
+                data = { 0x78, zlib_flags(level) };
+            }
+            if (level == 0) {
+                store_band(filtered, data);
+            } else {
+                deflate_band(filtered, k_max_probes[level], data);
+            }
+            chunks[band] = png_chunk("IDAT", data);
+        }
+    );
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<uint8_t> header;
+    put_u32_be(header, wd);
+    put_u32_be(header, hgt);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+    auto append = [&](const std::vector<uint8_t>& chunk) {
+        png.insert(png.end(), chunk.begin(), chunk.end());
+    };
+    append(png_chunk("IHDR", header));
+
+    uint32_t adler = 1;
+    for (int band = 0; band < num_bands; ++band) {
+        append(chunks[band]);
+        adler = adler32_combine(adler, adlers[band], lengths[band]);
+    }
+
+    // an empty final block of fixed codes, then the checksum.
+    std::vector<uint8_t> tail = { 0x03, 0x00 };
+    put_u32_be(tail, adler);
+    append(png_chunk("IDAT", tail));
+    append(png_chunk("IEND", {}));
+    return png;
+}
+
+std::vector<uint8_t> flo::encode_qoi(const image& img) {
+    constexpr uint8_t k_op_index = 0x00;
+    constexpr uint8_t k_op_diff = 0x40;
+    constexpr uint8_t k_op_luma = 0x80;
+    constexpr uint8_t k_op_run = 0xc0;
+    constexpr uint8_t k_op_rgb = 0xfe;
+    constexpr uint8_t k_op_rgba = 0xff;
+    constexpr int k_max_run = 62;
+
+    std::vector<uint8_t> qoi = { 'q', 'o', 'i', 'f' };
+    put_u32_be(qoi, img.cols());
+    put_u32_be(qoi, img.rows());
+    qoi.insert(qoi.end(), { 4, 0 });
+
+    std::array<std::array<uint8_t, 4>, 64> index{};
+    std::array<uint8_t, 4> prev = { 0, 0, 0, 255 };
+    int run = 0;
+    const auto* pixels = static_cast<const uint8_t*>(img.data());
+    size_t num_pixels = static_cast<size_t>(img.cols()) * img.rows();
+    for (size_t i = 0; i < num_pixels; ++i) {
+        std::array<uint8_t, 4> px = {
+            pixels[4 * i], pixels[4 * i + 1], pixels[4 * i + 2], pixels[4 * i + 3]
+        };
+        if (px == prev) {
+            if (++run == k_max_run) {
+                qoi.push_back(k_op_run | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            qoi.push_back(k_op_run | (run - 1));
+            run = 0;
+        }
+
+        int slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (index[slot] == px) {
+            qoi.push_back(k_op_index | slot);
+        } else if (px[3] != prev[3]) {
+            index[slot] = px;
+            qoi.insert(qoi.end(), { k_op_rgba, px[0], px[1], px[2], px[3] });
+        } else {
+            index[slot] = px;
+            auto dr = static_cast<int8_t>(px[0] - prev[0]);
+            auto dg = static_cast<int8_t>(px[1] - prev[1]);
+            auto db = static_cast<int8_t>(px[2] - prev[2]);
+            int dr_dg = dr - dg;
+            int db_dg = db - dg;
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                qoi.push_back(k_op_diff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+            } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                    db_dg >= -8 && db_dg <= 7) {
+                qoi.push_back(k_op_luma | (dg + 32));
+                qoi.push_back(static_cast<uint8_t>(((dr_dg + 8) << 4) | (db_dg + 8)));
+            } else {
+                qoi.insert(qoi.end(), { k_op_rgb, px[0], px[1], px[2] });
+            }
+        }
+        prev = px;
+    }
+    if (run > 0) {
+        qoi.push_back(k_op_run | (run - 1));
+    }
+    qoi.insert(qoi.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+    return qoi;
+}
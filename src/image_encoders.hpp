@@ -0,0 +1,25 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // png compression levels run from 0, no compression, through 1, the fastest, to 9,
+    // the smallest.
+    constexpr int k_default_png_level = 6;
+
+    // the image is compressed in bands of rows, in parallel, each band ending on a byte
+    // boundary of the deflate stream and stored as its own IDAT chunk. Bands are a fixed
+    // size, so the file does not depend on the number of threads. num_threads of 0 means
+    // one thread per hardware core.
+    std::vector<uint8_t> encode_png(const image& img, int level = k_default_png_level,
+        int num_threads = 1);
+
+    // the QOI format, which is lossless like PNG but much faster to encode and larger.
+    std::vector<uint8_t> encode_qoi(const image& img);
+
+}
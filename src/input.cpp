@@ -1,5 +1,6 @@
 #include "input.hpp"
 #include "vector_field.hpp"
+#include "profiler.hpp"
 #include "third-party/json.hpp"
 #include <fstream>
 #include <string_view>
@@ -21,18 +22,26 @@ namespace {
     const std::string k_def = "def";
     const std::string k_octaves = "octaves";
     const std::string k_freq = "freq";
-    const std::string k_exponent = "exponent";
     const std::string k_normalized = "normalized";
     const std::string k_radius = "radius";
     const std::string k_filename = "filename";
     const std::string k_canvas_color = "canvas_color";
     const std::string k_alpha_threshold = "alpha_threshold";
+    const std::string k_canvas_layout = "canvas_layout";
+    const std::string k_png_level = "png_level";
+    const std::string k_frame_every = "frame_every";
+    const std::string k_frame_filename = "frame_filename";
+    const std::string k_canvas_paging = "canvas_paging";
+    const std::string k_interleaved = "interleaved";
+    const std::string k_planar = "planar";
+    const std::string k_tiled = "tiled";
     const std::string k_radius_ramp_in_time = "radius_ramp_in_time";
     const std::string k_mix = "mix";
     const std::string k_overlay = "overlay";
     const std::string k_fill = "fill";
     const std::string k_mode = "mode";
     const std::string k_aa_level = "aa_level";
+    const std::string k_analytic = "analytic";
     const std::string k_paint_transfer_coeff = "paint_transfer_coeff";
     const std::string k_stroke_lifetime = "stroke_lifetime";
     const std::string k_mean = "mean";
@@ -48,6 +57,7 @@ namespace {
     const std::string k_palette_subset = "palette_subset";
     const std::string k_diffusion_rate = "diffusion_rate";
     const std::string k_jitter = "jitter";
+    const std::string k_num_threads = "num_threads";
     const std::string k_weight = "weight";
     const std::string k_brush = "brush";
     const std::string k_rand_seed = "rand_seed";
@@ -73,8 +83,16 @@ namespace {
     const std::string k_gravity = "gravity";
     const std::string k_masses = "masses";
     const std::string k_grav_const = "grav_const";
+    const std::string k_theta = "theta";
+    const std::string k_gradient = "gradient";
+    const std::string k_image = "image";
+    const std::string k_kernel_sz = "kernel_sz";
+    const std::string k_hamiltonian = "hamiltonian";
+    const std::string k_footprint_cache = "footprint_cache";
+    const std::string k_subpixel_grid = "subpixel_grid";
+    const std::string k_max_megabytes = "max_megabytes";
 
-    flo::vector_field vector_field_from_json_aux(const flo::dimensions& dim, const json& json_obj);
+    flo::field_rows vector_field_from_json_aux(const flo::dimensions& dim, const json& json_obj);
 
     flo::circle_field_type parse_circle_field_type(const json& json_value) {
         if (!json_value.is_string()) {
@@ -96,62 +114,63 @@ namespace {
         }
     }
 
-    flo::vector_field perlin_field_fn(const flo::dimensions& dim, const json& node) {
-        return perlin_vector_field(dim, node[k_octaves], node[k_freq],
-            node.value(k_exponent, 1.0), node.value(k_normalized, true));
+    flo::field_rows perlin_field_fn(const flo::dimensions& dim, const json& node) {
+        return perlin_field_rows(dim, node[k_octaves], node[k_freq], node.value(k_normalized, true));
     }
 
-    flo::vector_field zigzag_field_fn(const flo::dimensions& dim, const json& node) {
-        return zigzag_vector_field(dim, node[k_radius]);
+    flo::field_rows zigzag_field_fn(const flo::dimensions& dim, const json& node) {
+        return zigzag_field_rows(dim, node[k_radius]);
     }
 
-    flo::vector_field normalize_field_fn(const flo::dimensions& dim, const json& node) {
-        return normalize(vector_field_from_json_aux(dim, node[k_arg]));
+    flo::field_rows normalize_field_fn(const flo::dimensions& dim, const json& node) {
+        return flo::normalize_rows(vector_field_from_json_aux(dim, node[k_arg]));
     }
 
-    flo::vector_field multiply_field_fn(const flo::dimensions& dim, const json& node) {
+    flo::field_rows multiply_field_fn(const flo::dimensions& dim, const json& node) {
         if (node[k_arg1].is_array()) {
             flo::point v{ node[k_arg1][0], node[k_arg1][1] };
-            return v * vector_field_from_json_aux(dim, node[k_arg2]);
+            return flo::scale_rows(v, vector_field_from_json_aux(dim, node[k_arg2]));
         }
         else {
             double scalar = node[k_arg1];
-            return scalar * vector_field_from_json_aux(dim, node[k_arg2]);
+            return flo::scale_rows(scalar, vector_field_from_json_aux(dim, node[k_arg2]));
         }
     }
 
-    flo::vector_field add_field_fn(const flo::dimensions& dim, const json& node) {
+    flo::field_rows add_field_fn(const flo::dimensions& dim, const json& node) {
         if (node[k_arg1].is_array()) {
             flo::point v{ node[k_arg1][0], node[k_arg1][1] };
-            return v + vector_field_from_json_aux(dim, node[k_arg2]);
+            return flo::offset_rows(v, vector_field_from_json_aux(dim, node[k_arg2]));
         } else if (node[k_arg2].is_array()) {
             flo::point v{ node[k_arg2][0], node[k_arg2][1] };
-            return v + vector_field_from_json_aux(dim, node[k_arg1]);
+            return flo::offset_rows(v, vector_field_from_json_aux(dim, node[k_arg1]));
         } else if (node[k_arg1].is_number()) {
             double k = node[k_arg1];
-            return k + vector_field_from_json_aux(dim, node[k_arg2]);
+            return flo::offset_rows(k, vector_field_from_json_aux(dim, node[k_arg2]));
         } else {
-            return vector_field_from_json_aux(dim, node[k_arg1]) +
-                vector_field_from_json_aux(dim, node[k_arg2]);
+            // built in document order, as building a field may draw random seeds.
+            auto lhs = vector_field_from_json_aux(dim, node[k_arg1]);
+            auto rhs = vector_field_from_json_aux(dim, node[k_arg2]);
+            return flo::sum_rows(std::move(lhs), std::move(rhs));
         }
     }
 
-    flo::vector_field circular_field_fn(const flo::dimensions& dim, const json& node) {
-        return circular_vector_field(dim, parse_circle_field_type(node[k_type]));
+    flo::field_rows circular_field_fn(const flo::dimensions& dim, const json& node) {
+        return circular_field_rows(dim, parse_circle_field_type(node[k_type]));
     }
 
-    flo::vector_field elliptic_field_fn(const flo::dimensions& dim, const json& node) {
-        return elliptic_vector_field(dim, parse_circle_field_type(node[k_type]));
+    flo::field_rows elliptic_field_fn(const flo::dimensions& dim, const json& node) {
+        return elliptic_field_rows(dim, parse_circle_field_type(node[k_type]));
     }
 
-    flo::vector_field loxo_spiral_field_fn(const flo::dimensions& dim, const json& node) {
-        return loxodromic_spiral_vector_field(
+    flo::field_rows loxo_spiral_field_fn(const flo::dimensions& dim, const json& node) {
+        return loxodromic_spiral_field_rows(
             dim, node[k_outward], node[k_centers_dist], node[k_theta_rate]
         );
     }
 
-    flo::vector_field log_spiral_field_fn(const flo::dimensions& dim, const json& node) {
-        return logarithmic_spiral_vector_field(dim, node[k_growth_rate], node[k_inward], node[k_clockwise]);
+    flo::field_rows log_spiral_field_fn(const flo::dimensions& dim, const json& node) {
+        return logarithmic_spiral_field_rows(dim, node[k_growth_rate], node[k_inward], node[k_clockwise]);
     }
 
     std::vector<flo::point_mass> to_point_mass_array(const json& jobj) {
@@ -174,18 +193,35 @@ namespace {
         return result;
     }
     
-    flo::vector_field gravity_field_fn(const flo::dimensions& dim, const json& node) {
-        return gravity(
-            dim,
+    flo::field_rows gravity_field_fn(const flo::dimensions&, const json& node) {
+        return gravity_field_rows(
             to_point_mass_array(node[k_masses]),
             (node.contains(k_grav_const)) ? node[k_grav_const].get<double>() : 1.0,
-            (node.contains(k_normalize)) ? node[k_normalize].get<bool>() : true
+            (node.contains(k_normalize)) ? node[k_normalize].get<bool>() : true,
+            node.value(k_theta, 0.0)
         );
     }
 
-    flo::vector_field vector_field_from_json_aux(const flo::dimensions& dim, const json& json_obj) {
+    // the gradient of an image's luminance, which is loaded and differentiated when the
+    // definition is parsed, so a bad image fails before anything is painted. The gradient
+    // is held by the definition for the rest of the run.
+    flo::field_rows gradient_field_fn(const flo::dimensions& dim, const json& node) {
+        auto img = flo::to_gray_scale(flo::img_from_file(node[k_image].get<std::string>()));
+        return flo::stored_field_rows(dim,
+            flo::gradient(
+                img,
+                node[k_kernel_sz].get<int>(),
+                node.value(k_hamiltonian, false),
+                node.value(k_num_threads, 0)
+            )
+        );
+    }
+
+    // a field definition is parsed into a graph of row evaluators, which is then evaluated
+    // in a single pass without materializing the intermediate fields.
+    flo::field_rows vector_field_from_json_aux(const flo::dimensions& dim, const json& json_obj) {
         using namespace flo;
-        using vector_field_fn = std::function<flo::vector_field(const dimensions&, const json&)>;
+        using vector_field_fn = std::function<flo::field_rows(const dimensions&, const json&)>;
 
         static const std::unordered_map<std::string, vector_field_fn> operations = {
             {k_perlin, perlin_field_fn},
@@ -197,7 +233,8 @@ namespace {
             {k_elliptic, elliptic_field_fn},
             {k_loxo_spiral, loxo_spiral_field_fn},
             {k_log_spiral, log_spiral_field_fn},
-            {k_gravity, gravity_field_fn}
+            {k_gravity, gravity_field_fn},
+            {k_gradient, gradient_field_fn}
         };
 
         const auto& fn = operations.at(json_obj[k_op].get<std::string>());
@@ -205,18 +242,37 @@ namespace {
     }
 
 
-    flo::vector_field vector_field_from_json(const json& json_obj) {
+    flo::deferred_field vector_field_from_json(const json& json_obj) {
         using namespace flo;
         dimensions dim{ json_obj[k_dimensions][0], json_obj[k_dimensions][1] };
         const json& def = json_obj[k_def];
-        return vector_field_from_json_aux(dim, def);
+        return { dim, vector_field_from_json_aux(dim, def), json_obj.value(k_num_threads, 0) };
+    }
+
+    flo::storage_layout parse_canvas_layout(const json& json_value) {
+        std::string layout_str = json_value.get<std::string>();
+        if (layout_str == k_interleaved) {
+            return flo::storage_layout::interleaved;
+        } else if (layout_str == k_planar) {
+            return flo::storage_layout::planar;
+        } else if (layout_str == k_tiled) {
+            return flo::storage_layout::tiled;
+        } else {
+            throw std::invalid_argument("Invalid canvas_layout: " + layout_str);
+        }
     }
 
     flo::output_params parse_output_params(const std::string out_file, const json& j) {
         flo::output_params out{
             out_file,
             flo::hex_str_to_rgb("#ffffff"),
-            1.0
+            1.0,
+            flo::storage_layout::interleaved,
+            0,
+            flo::k_default_png_level,
+            0,
+            out_file,
+            {}
         };
         if (j.contains(k_output)) {
             const auto& out_params = j[k_output];
@@ -224,6 +280,26 @@ namespace {
                 flo::hex_str_to_rgb(out_params[k_canvas_color].get<std::string>()) :
                 flo::hex_str_to_rgb("#ffffff");
             out.alpha_threshold = out_params.value(k_alpha_threshold, 1.0);
+            if (out_params.contains(k_canvas_layout)) {
+                out.canvas_layout = parse_canvas_layout(out_params[k_canvas_layout]);
+            }
+            out.num_threads = out_params.value(k_num_threads, 0);
+            out.png_level = out_params.value(k_png_level, flo::k_default_png_level);
+            if (out.png_level < 0 || out.png_level > 9) {
+                throw std::invalid_argument("png_level must be from 0 to 9");
+            }
+            out.frame_every = out_params.value(k_frame_every, 0);
+            out.frame_filename = out_params.value(k_frame_filename, out_file);
+            if (out_params.contains(k_canvas_paging)) {
+                const auto& paging = out_params[k_canvas_paging];
+                out.canvas_paging = flo::paging_params{
+                    paging.value(k_filename, out_file + ".tiles"),
+                    paging.value(k_max_megabytes, 1024.0)
+                };
+                if (out.canvas_paging->max_megabytes <= 0.0) {
+                    throw std::invalid_argument("canvas_paging max_megabytes must be positive");
+                }
+            }
         }
         return out;
     }
@@ -246,6 +322,17 @@ namespace {
         }
     }
 
+    int parse_aa_level(const json& json_value) {
+        if (json_value.is_string()) {
+            std::string level_str = json_value.get<std::string>();
+            if (level_str != k_analytic) {
+                throw std::invalid_argument("Invalid aa_level: " + level_str);
+            }
+            return flo::k_analytic_aa_level;
+        }
+        return json_value.get<int>();
+    }
+
     flo::brush_params parse_brush_params(const json& j) {
         flo::brush_params brush;
         brush.radius = j[k_radius].get<double>();
@@ -254,7 +341,7 @@ namespace {
         }
         brush.mix = j[k_mix].get<bool>();
         brush.mode = parse_paint_mode(j[k_mode]);
-        brush.aa_level = j[k_aa_level].get<int>();
+        brush.aa_level = parse_aa_level(j[k_aa_level]);
         brush.paint_transfer_coeff = j[k_paint_transfer_coeff].get<double>();
 
         if (j.contains(k_stroke_lifetime)) {
@@ -269,6 +356,13 @@ namespace {
         return brush;
     }
 
+    flo::footprint_cache_params parse_footprint_cache_params(const json& j) {
+        auto params = flo::footprint_cache::default_params();
+        params.subpixel_grid = j.value(k_subpixel_grid, params.subpixel_grid);
+        params.max_megabytes = j.value(k_max_megabytes, params.max_megabytes);
+        return params;
+    }
+
     flo::flowbee_params parse_flowbee_params(const json& j) {
         flo::flowbee_params params;
         params.particle_volume = j[k_particle_volume].get<double>();
@@ -299,6 +393,10 @@ namespace {
             params.jitter = jitter;
         }
 
+        if (j.contains(k_num_threads)) {
+            params.num_threads = j[k_num_threads].get<int>();
+        }
+
         if (j.contains(k_brush)) {
             params.brush = parse_brush_params(j[k_brush]);
         }
@@ -326,17 +424,24 @@ std::expected<flo::input, std::string> flo::parse_input(
             set_rand_seed(*parsed_input.rand_seed);
         }
 
+        if (j.contains(k_footprint_cache)) {
+            brush_footprints().configure(parse_footprint_cache_params(j[k_footprint_cache]));
+        }
+
         parsed_input.output = parse_output_params(outp, j);
 
         for (const auto& color_str : j[k_palette]) {
             parsed_input.palette.push_back(hex_str_to_rgb(color_str.get<std::string>()));
         }
 
+        // fields are only defined here, in document order since definitions may draw
+        // random seeds; they are evaluated as the layers are painted.
         for (const auto& layer : j[k_layers]) {
-            layer_params lp;
-            lp.flow = vector_field_from_json(layer[k_flow]);
-            lp.params = parse_flowbee_params(layer[k_params]);
-            parsed_input.layers.push_back(lp);
+            FLO_PROFILE_SCOPE("field_definition");
+            parsed_input.layers.push_back({
+                vector_field_from_json(layer[k_flow]),
+                parse_flowbee_params(layer[k_params])
+            });
         }
 
         return parsed_input;
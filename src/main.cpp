@@ -6,6 +6,8 @@
 #include "brush.hpp"
 #include "flowbee.hpp"
 #include "input.hpp"
+#include "profiler.hpp"
+#include "random.hpp"
 #include <iostream>
 #include <vector>
 #include <filesystem>
@@ -17,14 +19,67 @@
 #include <deque>
 #include <numbers>
 #include <chrono>
+#include <charconv>
+#include <optional>
+#include <exception>
 
 /*------------------------------------------------------------------------------------------------*/
 namespace {
 
+    // how often a render checkpoints when a checkpoint file is named without
+    // --checkpoint-every.
+    constexpr int k_default_checkpoint_every = 1000;
+
     std::string filename(const std::string& str) {
         return std::filesystem::path(str).filename().string();
     }
 
+    struct options {
+        std::string profile_report;
+        flo::checkpoint_params checkpoints;
+    };
+
+    // the flags following the input and output filenames, each of which takes a value.
+    std::optional<options> parse_options(int argc, char* argv[]) {
+        options opts;
+        for (int i = 3; i < argc; i += 2) {
+            if (i + 1 == argc) {
+                return {};
+            }
+            std::string flag = argv[i];
+            std::string value = argv[i + 1];
+            if (flag == "--profile") {
+                opts.profile_report = value;
+            } else if (flag == "--checkpoint") {
+                opts.checkpoints.filename = value;
+            } else if (flag == "--resume") {
+                opts.checkpoints.resume_from = value;
+            } else if (flag == "--checkpoint-every") {
+                auto [end, ec] = std::from_chars(
+                    value.data(), value.data() + value.size(), opts.checkpoints.every
+                );
+                if (ec != std::errc{} || end != value.data() + value.size() ||
+                        opts.checkpoints.every <= 0) {
+                    return {};
+                }
+            } else {
+                return {};
+            }
+        }
+
+        if (!opts.checkpoints.filename.empty() && opts.checkpoints.every == 0) {
+            opts.checkpoints.every = k_default_checkpoint_every;
+        }
+
+        // by default a resumed render keeps checkpointing to the file it resumed from.
+        if (opts.checkpoints.every > 0 && opts.checkpoints.filename.empty()) {
+            opts.checkpoints.filename = opts.checkpoints.resume_from.empty() ?
+                std::string(argv[2]) + ".ckpt" :
+                opts.checkpoints.resume_from;
+        }
+        return opts;
+    }
+
     void test() {
         std::vector<flo::rgb_color> pal = { {255,255,255},{255,0,0} };
         flo::canvas canv(pal, 100, 100);
@@ -53,36 +108,66 @@ int main(int argc, char* argv[]) {
 
     //test();
 
-    if (argc != 3) {
+    auto opts = (argc >= 3) ? parse_options(argc, argv) : std::nullopt;
+    if (!opts) {
         for (int i = 0; i < argc; ++i) {
             std::println("{} ", argv[i]);
         }
-        std::println(" usage is 'flowbee.exe params.json output_image.png'");
+        std::println(" usage is 'flowbee.exe params.json output_image.png [--profile report.json]"
+            " [--checkpoint-every iterations] [--checkpoint state.ckpt] [--resume state.ckpt]'");
+        return -1;
+    }
+    const auto& profile_report = opts->profile_report;
+    const auto& checkpoints = opts->checkpoints;
+
+    if (!profile_report.empty()) {
+#ifdef FLO_PROFILING
+        flo::profiler::enable();
+#else
+        std::println("[error] this build of flowbee does not support --profile");
         return -1;
+#endif
     }
 
     flo::display_title();
 
-    auto input = flo::parse_input( argv[1], argv[2] );
-    if (!input) {
-        std::println("[error] {}", input.error());
-        return -1;
-    }
+    try {
+        // the input is parsed with the streams seeded as they were for the checkpointed
+        // run, so that random fields come out the same.
+        if (!checkpoints.resume_from.empty()) {
+            flo::seed_rng_streams(flo::checkpoint_seed(checkpoints.resume_from));
+        }
+
+        auto input = flo::parse_input( argv[1], argv[2] );
+        if (!input) {
+            std::println("[error] {}", input.error());
+            return -1;
+        }
 
-    std::println("  processing '{}'...\n", filename(argv[1]));
+        std::println("  processing '{}'...\n", filename(argv[1]));
 
-    auto start_time = std::chrono::high_resolution_clock::now();
+        auto start_time = std::chrono::high_resolution_clock::now();
 
-    flo::do_flowbee(
-        input->output,
-        input->palette,
-        input->layers
-    );
+        flo::do_flowbee(
+            input->output,
+            input->palette,
+            input->layers,
+            checkpoints
+        );
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end_time - start_time;
+        std::println("    {} seconds\n", elapsed.count());
+        std::println("  generated '{}'.", filename(input->output.filename));
 
-    auto end_time = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end_time - start_time;
-    std::println("    {} seconds\n", elapsed.count());
-    std::println("  generated '{}'.", filename(input->output.filename));
+        if (!profile_report.empty()) {
+            flo::profiler::write_report(profile_report);
+            std::println("  wrote profile '{}'.", filename(profile_report));
+        }
+    } catch (const std::exception& e) {
+        std::println("[error] {}", e.what());
+        return -1;
+    }
 
     return 0;
 }
\ No newline at end of file
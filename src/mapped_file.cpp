@@ -0,0 +1,213 @@
+#include "mapped_file.hpp"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*------------------------------------------------------------------------------------------------*/
+
+#ifdef _WIN32
+
+flo::mapped_file::mapped_file() :
+    data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr)
+{
+}
+
+flo::mapped_file flo::mapped_file::open_for_reading(const std::string& fname) {
+    mapped_file mf;
+    mf.file_ = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mf.file_ == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("unable to open " + fname);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mf.file_, &size) || size.QuadPart == 0) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    mf.size_ = static_cast<size_t>(size.QuadPart);
+    mf.mapping_ = CreateFileMappingA(mf.file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mf.mapping_) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    mf.data_ = static_cast<std::byte*>(MapViewOfFile(mf.mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!mf.data_) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    return mf;
+}
+
+flo::mapped_file flo::mapped_file::create(const std::string& fname, size_t size) {
+    mapped_file mf;
+    mf.file_ = CreateFileA(fname.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mf.file_ == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("unable to create " + fname);
+    }
+    mf.size_ = size;
+    auto size_high = static_cast<DWORD>(static_cast<uint64_t>(size) >> 32);
+    auto size_low = static_cast<DWORD>(size & 0xffffffff);
+    mf.mapping_ = CreateFileMappingA(
+        mf.file_, nullptr, PAGE_READWRITE, size_high, size_low, nullptr
+    );
+    if (!mf.mapping_) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    mf.data_ = static_cast<std::byte*>(MapViewOfFile(mf.mapping_, FILE_MAP_WRITE, 0, 0, 0));
+    if (!mf.data_) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    return mf;
+}
+
+void flo::mapped_file::release() {
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(file_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+}
+
+flo::mapped_file::mapped_file(mapped_file&& other) noexcept :
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    file_(std::exchange(other.file_, INVALID_HANDLE_VALUE)),
+    mapping_(std::exchange(other.mapping_, nullptr))
+{
+}
+
+flo::mapped_file& flo::mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        file_ = std::exchange(other.file_, INVALID_HANDLE_VALUE);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+    }
+    return *this;
+}
+
+void flo::mapped_file::release_pages(size_t offset, size_t size) {
+    // unlocking pages that are not locked removes them from the working set.
+    VirtualUnlock(data_ + offset, size);
+}
+
+void flo::mapped_file::flush() {
+    if (!FlushViewOfFile(data_, size_) || !FlushFileBuffers(file_)) {
+        throw std::runtime_error("unable to flush a mapped file");
+    }
+}
+
+#else
+
+flo::mapped_file::mapped_file() :
+    data_(nullptr), size_(0), fd_(-1)
+{
+}
+
+flo::mapped_file flo::mapped_file::open_for_reading(const std::string& fname) {
+    mapped_file mf;
+    mf.fd_ = ::open(fname.c_str(), O_RDONLY);
+    if (mf.fd_ < 0) {
+        throw std::runtime_error("unable to open " + fname);
+    }
+    struct stat info;
+    if (fstat(mf.fd_, &info) != 0 || info.st_size == 0) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    mf.size_ = static_cast<size_t>(info.st_size);
+    void* data = mmap(nullptr, mf.size_, PROT_READ, MAP_PRIVATE, mf.fd_, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    mf.data_ = static_cast<std::byte*>(data);
+    return mf;
+}
+
+flo::mapped_file flo::mapped_file::create(const std::string& fname, size_t size) {
+    mapped_file mf;
+    mf.fd_ = ::open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (mf.fd_ < 0) {
+        throw std::runtime_error("unable to create " + fname);
+    }
+    if (ftruncate(mf.fd_, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error("unable to size " + fname);
+    }
+    mf.size_ = size;
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mf.fd_, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("unable to map " + fname);
+    }
+    mf.data_ = static_cast<std::byte*>(data);
+    return mf;
+}
+
+void flo::mapped_file::release() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    fd_ = -1;
+}
+
+flo::mapped_file::mapped_file(mapped_file&& other) noexcept :
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    fd_(std::exchange(other.fd_, -1))
+{
+}
+
+flo::mapped_file& flo::mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        fd_ = std::exchange(other.fd_, -1);
+    }
+    return *this;
+}
+
+void flo::mapped_file::release_pages(size_t offset, size_t size) {
+    // this is only advice, so failure is not an error.
+    madvise(data_ + offset, size, MADV_DONTNEED);
+}
+
+void flo::mapped_file::flush() {
+    if (msync(data_, size_, MS_SYNC) != 0 || fsync(fd_) != 0) {
+        throw std::runtime_error("unable to flush a mapped file");
+    }
+}
+
+#endif
+
+flo::mapped_file::~mapped_file() {
+    release();
+}
+
+std::span<std::byte> flo::mapped_file::bytes() {
+    return { data_, size_ };
+}
+
+std::span<const std::byte> flo::mapped_file::bytes() const {
+    return { data_, size_ };
+}
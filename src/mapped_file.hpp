@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // a file mapped into memory, either an existing file mapped for reading or a new file
+    // of a given size mapped for writing. The mapping is released when the object is
+    // destroyed, and anything written to it that has not been flushed is left to the
+    // operating system to write out.
+
+    class mapped_file {
+        std::byte* data_;
+        size_t size_;
+#ifdef _WIN32
+        void* file_;
+        void* mapping_;
+#else
+        int fd_;
+#endif
+
+        mapped_file();
+        void release();
+
+    public:
+        static mapped_file open_for_reading(const std::string& fname);
+        static mapped_file create(const std::string& fname, size_t size);
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        mapped_file(mapped_file&& other) noexcept;
+        mapped_file& operator=(mapped_file&& other) noexcept;
+        ~mapped_file();
+
+        std::span<std::byte> bytes();
+        std::span<const std::byte> bytes() const;
+
+        // drops the pages of a range of the mapping from the memory of the process. What
+        // was written to them is kept in the file and read back if they are used again.
+        // The range must begin on a page boundary.
+        void release_pages(size_t offset, size_t size);
+
+        // writes what has been written to the mapping through to the storage device,
+        // returning once it is there.
+        void flush();
+    };
+
+}
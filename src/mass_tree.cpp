@@ -0,0 +1,149 @@
+#include "mass_tree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <ranges>
+
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr int k_leaf_size = 4;
+
+    // masses that coincide cannot be separated by subdivision, so nodes this deep are
+    // leaves whatever their size.
+    constexpr int k_max_depth = 32;
+
+    void add_attraction(double x, double y, const flo::point& loc, double mass,
+            double& field_x, double& field_y) {
+        double dx = loc.x - x;
+        double dy = loc.y - y;
+        double dist_sq = dx * dx + dy * dy;
+        double dist = std::sqrt(dist_sq);
+
+        if (dist_sq > 1e-6) { // Avoid singularity
+            double force = mass / dist_sq;
+            field_x += force * (dx / dist);
+            field_y += force * (dy / dist);
+        }
+    }
+
+}
+
+flo::mass_tree::mass_tree(const std::vector<point_mass>& masses, double theta) :
+        masses_(masses),
+        theta_sq_(theta * theta) {
+
+    auto negative = r::partition(masses_, [](const point_mass& pm) { return pm.mass >= 0.0; });
+    int num_positive = static_cast<int>(masses_.size() - negative.size());
+
+    for (auto [begin, end] : { std::pair{ 0, num_positive },
+            std::pair{ num_positive, static_cast<int>(masses_.size()) } }) {
+        if (begin == end) {
+            continue;
+        }
+        auto [min_x, max_x] = r::minmax(
+            r::subrange(masses_.begin() + begin, masses_.begin() + end), {},
+            [](const point_mass& pm) { return pm.loc.x; }
+        );
+        auto [min_y, max_y] = r::minmax(
+            r::subrange(masses_.begin() + begin, masses_.begin() + end), {},
+            [](const point_mass& pm) { return pm.loc.y; }
+        );
+        double wd = std::max(max_x.loc.x - min_x.loc.x, max_y.loc.y - min_y.loc.y);
+        roots_.push_back(static_cast<int>(nodes_.size()));
+        nodes_.emplace_back();
+        build(roots_.back(), begin, end, min_x.loc.x, min_y.loc.y, wd, 0);
+    }
+}
+
+void flo::mass_tree::build(int index, int begin, int end, double x, double y, double wd,
+        int depth) {
+    double mass = 0.0;
+    double moment_x = 0.0;
+    double moment_y = 0.0;
+    for (int i = begin; i < end; ++i) {
+        mass += masses_[i].mass;
+        moment_x += masses_[i].mass * masses_[i].loc.x;
+        moment_y += masses_[i].mass * masses_[i].loc.y;
+    }
+    auto center_of_mass = (mass != 0.0) ?
+        point{ moment_x / mass, moment_y / mass } :
+        point{ x + wd / 2.0, y + wd / 2.0 };
+    nodes_[index] = { center_of_mass, mass, x, y, wd, -1, 0, begin, end };
+
+    if (end - begin <= k_leaf_size || depth == k_max_depth) {
+        return;
+    }
+
+    // split into quadrants: left then right, each split into top then bottom.
+    double half = wd / 2.0;
+    auto first = masses_.begin();
+    auto mid_x = std::partition(first + begin, first + end,
+        [&](const point_mass& pm) { return pm.loc.x < x + half; });
+    auto top_left = std::partition(first + begin, mid_x,
+        [&](const point_mass& pm) { return pm.loc.y < y + half; });
+    auto top_right = std::partition(mid_x, first + end,
+        [&](const point_mass& pm) { return pm.loc.y < y + half; });
+
+    int bounds[5] = {
+        begin,
+        static_cast<int>(top_left - first),
+        static_cast<int>(mid_x - first),
+        static_cast<int>(top_right - first),
+        end
+    };
+    double quadrant_x[4] = { x, x, x + half, x + half };
+    double quadrant_y[4] = { y, y + half, y, y + half };
+
+    // the non-empty children are allocated together so that they are contiguous.
+    int num_children = static_cast<int>(
+        r::count_if(rv::iota(0, 4), [&](int i) { return bounds[i] < bounds[i + 1]; })
+    );
+    int first_child = static_cast<int>(nodes_.size());
+    nodes_.resize(nodes_.size() + num_children);
+    nodes_[index].first_child = first_child;
+    nodes_[index].num_children = num_children;
+
+    int child = first_child;
+    for (int i = 0; i < 4; ++i) {
+        if (bounds[i] < bounds[i + 1]) {
+            build(child++, bounds[i], bounds[i + 1], quadrant_x[i], quadrant_y[i], half, depth + 1);
+        }
+    }
+}
+
+void flo::mass_tree::accumulate(
+        int index, double x, double y, double& field_x, double& field_y) const {
+    const auto& n = nodes_[index];
+
+    if (n.first_child < 0) {
+        for (int i = n.begin; i < n.end; ++i) {
+            add_attraction(x, y, masses_[i].loc, masses_[i].mass, field_x, field_y);
+        }
+        return;
+    }
+
+    bool inside = x >= n.x && x <= n.x + n.wd && y >= n.y && y <= n.y + n.wd;
+    double dx = n.center_of_mass.x - x;
+    double dy = n.center_of_mass.y - y;
+    if (!inside && n.wd * n.wd < theta_sq_ * (dx * dx + dy * dy)) {
+        add_attraction(x, y, n.center_of_mass, n.mass, field_x, field_y);
+        return;
+    }
+
+    for (int child = n.first_child; child < n.first_child + n.num_children; ++child) {
+        accumulate(child, x, y, field_x, field_y);
+    }
+}
+
+flo::point flo::mass_tree::field_at(double x, double y) const {
+    double field_x = 0.0;
+    double field_y = 0.0;
+    for (int root : roots_) {
+        accumulate(root, x, y, field_x, field_y);
+    }
+    return { field_x, field_y };
+}
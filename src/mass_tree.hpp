@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vector_field.hpp"
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // a quadtree over point masses for Barnes-Hut evaluation of their gravitational field.
+    // A node that, seen from the sample point, is narrower than theta times its distance is
+    // treated as a single mass at its center of mass; other nodes are opened, and the
+    // masses in leaves are summed exactly. Positive and negative masses are kept in
+    // separate trees, as the center of mass of masses that nearly cancel means nothing.
+
+    class mass_tree {
+        struct node {
+            point center_of_mass;
+            double mass;
+            double x;
+            double y;
+            double wd;
+            int first_child;
+            int num_children;
+            int begin;
+            int end;
+        };
+
+        std::vector<point_mass> masses_;
+        std::vector<node> nodes_;
+        std::vector<int> roots_;
+        double theta_sq_;
+
+        void build(int index, int begin, int end, double x, double y, double wd, int depth);
+        void accumulate(int index, double x, double y, double& field_x, double& field_y) const;
+
+    public:
+        mass_tree(const std::vector<point_mass>& masses, double theta);
+
+        // the sum of mass / distance^2 along the unit vectors toward the masses at (x, y).
+        point field_at(double x, double y) const;
+    };
+
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "matrix.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
 
 namespace flo {
 
@@ -10,128 +14,218 @@ namespace flo {
         int depth;
     };
 
+    // how the layers of a matrix_3d are arranged in memory. interleaved stores the layers
+    // of each cell together, planar stores one contiguous plane per layer, and tiled
+    // stores square tiles of cells one after another, planar within each tile.
+    enum class storage_layout {
+        interleaved,
+        planar,
+        tiled
+    };
+
     template<typename T>
     class matrix_3d {
         std::vector<T> impl_;
         int cols_;
         int rows_;
         int layers_;
+        storage_layout layout_;
+        int tiles_x_;
+        std::ptrdiff_t cell_stride_;
+        std::ptrdiff_t row_stride_;
+        std::ptrdiff_t layer_stride_;
 
         // Proxy class for handling operations across layers
-        class cell_proxy {
-            T* data_;
+        template<typename U>
+        class basic_cell_proxy {
+            U* data_;
             int layers_;
+            std::ptrdiff_t stride_;
 
         public:
-            cell_proxy(T* data, int layers) : data_(data), layers_(layers) {}
-
-            cell_proxy(const std::vector<double>& v) : data_(const_cast<T*>(v.data())), layers_(v.size()) {}
+            basic_cell_proxy(U* data, int layers, std::ptrdiff_t stride) :
+                data_(data), layers_(layers), stride_(stride) {}
 
-            // Conversion to std::span<T> for read/write access
-            operator std::span<T>() {
-                return std::span<T>(data_, layers_);
+            int size() const {
+                return layers_;
             }
 
             // Conversion to std::vector<T> for read access
             operator std::vector<T>() const {
-                return std::vector<T>{data_, data_ + layers_};
+                std::vector<T> values(layers_);
+                for (int i = 0; i < layers_; ++i) {
+                    values[i] = data_[i * stride_];
+                }
+                return values;
             }
 
             T operator[](int i) const {
-                return data_[i];
-            }
-
-            cell_proxy& operator=(const std::vector<T>& values) {
-                if (values.size() != static_cast<size_t>(layers_)) {
-                    throw std::invalid_argument("Vector size must match the number of layers.");
-                }
-                std::copy(values.begin(), values.end(), data_);
-                return *this;
+                return data_[i * stride_];
             }
 
-            cell_proxy& operator=(std::span<const T> values) {
+            basic_cell_proxy& operator=(std::span<const T> values) {
                 if (values.size() != static_cast<size_t>(layers_)) {
                     throw std::invalid_argument("Span size must match the number of layers.");
                 }
-                std::copy(values.begin(), values.end(), data_);
-                return *this;
-            }
-
-            cell_proxy operator+=(cell_proxy other) {
                 for (int i = 0; i < layers_; ++i) {
-                    data_[i] += other.data_[i];
+                    data_[i * stride_] = values[i];
                 }
                 return *this;
             }
-        };
 
-    public:
-        matrix_3d() : cols_{ 0 }, rows_{ 0 }, layers_{ 0 } {}
+            basic_cell_proxy& operator=(const std::vector<T>& values) {
+                return *this = std::span<const T>(values);
+            }
+        };
 
-        matrix_3d(int cols, int rows, int layers) :
-            cols_(cols), rows_(rows), layers_(layers), impl_(cols* rows* layers) {
+        using cell_proxy = basic_cell_proxy<T>;
+        using const_cell_proxy = basic_cell_proxy<const T>;
+
+        std::ptrdiff_t index(int x, int y, int z) const {
+            switch (layout_) {
+                case storage_layout::planar:
+                    return z * layer_stride_ + y * row_stride_ + x;
+                case storage_layout::tiled: {
+                    std::ptrdiff_t tile = (y / k_tile_size) * tiles_x_ + (x / k_tile_size);
+                    return tile * k_tile_area * layers_ + z * layer_stride_ +
+                        (y % k_tile_size) * row_stride_ + (x % k_tile_size);
+                }
+                default:
+                    return y * row_stride_ + x * cell_stride_ + z;
+            }
         }
 
-        matrix_3d(int cols, int rows, int layers, const T& v) :
-            cols_(cols), rows_(rows), layers_(layers), impl_(cols* rows* layers, v) {
+        void check_bounds(int x, int y) const {
+            if (x < 0 || x >= cols_ || y < 0 || y >= rows_) {
+                throw std::out_of_range("Coordinates out of bounds");
+            }
         }
 
-        matrix_3d(const dimensions_3d& dim) : matrix_3d(dim.wd, dim.hgt, dim.depth) {}
+    public:
+        static constexpr int k_tile_size = 64;
+        static constexpr int k_tile_area = k_tile_size * k_tile_size;
+
+        matrix_3d() : matrix_3d(0, 0, 0) {}
+
+        matrix_3d(int cols, int rows, int layers, const T& v = T{},
+                storage_layout layout = storage_layout::interleaved) :
+                cols_(cols), rows_(rows), layers_(layers), layout_(layout), tiles_x_(0) {
+            std::ptrdiff_t storage_cells = static_cast<std::ptrdiff_t>(cols) * rows;
+            switch (layout) {
+                case storage_layout::planar:
+                    cell_stride_ = 1;
+                    row_stride_ = cols;
+                    layer_stride_ = storage_cells;
+                    break;
+                case storage_layout::tiled: {
+                    tiles_x_ = (cols + k_tile_size - 1) / k_tile_size;
+                    int tiles_y = (rows + k_tile_size - 1) / k_tile_size;
+                    storage_cells = static_cast<std::ptrdiff_t>(tiles_x_) * tiles_y * k_tile_area;
+                    cell_stride_ = 1;
+                    row_stride_ = k_tile_size;
+                    layer_stride_ = k_tile_area;
+                    break;
+                }
+                default:
+                    cell_stride_ = layers;
+                    row_stride_ = static_cast<std::ptrdiff_t>(cols) * layers;
+                    layer_stride_ = 1;
+            }
+            impl_.assign(storage_cells * layers, v);
+        }
 
-        matrix_3d(const dimensions_3d& dim, const T& v) : matrix_3d(dim.wd, dim.hgt, dim.depth, v) {}
+        matrix_3d(const dimensions_3d& dim, const T& v = T{},
+            storage_layout layout = storage_layout::interleaved) :
+            matrix_3d(dim.wd, dim.hgt, dim.depth, v, layout) {}
 
         T& operator[](int x, int y, int z) {
-            int index = y * (cols_ * layers_) + x * layers_ + z;
-            return impl_[index];
+            return impl_[index(x, y, z)];
         }
 
         const T& operator[](int x, int y, int z) const {
-            int index = y * (cols_ * layers_) + x * layers_ + z;
-            return impl_[index];
+            return impl_[index(x, y, z)];
         }
 
         T& operator[](const coords_3d& loc) {
-            int index = loc.y * (cols_ * layers_) + loc.x * layers_ + loc.z;
-            return impl_[index];
+            return impl_[index(loc.x, loc.y, loc.z)];
         }
 
         const T& operator[](const coords_3d& loc) const {
-            int index = loc.y * (cols_ * layers_) + loc.x * layers_ + loc.z;
-            return impl_[index];
+            return impl_[index(loc.x, loc.y, loc.z)];
         }
 
         T& operator[](const coords& loc, int layer) {
-            return (*this)[coords_3d{ loc.x, loc.y, layer }];
+            return impl_[index(loc.x, loc.y, layer)];
         }
 
         const T& operator[](const coords& loc, int layer) const {
-            return (*this)[coords_3d{ loc.x, loc.y, layer }];
+            return impl_[index(loc.x, loc.y, layer)];
         }
 
         cell_proxy operator[](const coords& loc) {
-            if (loc.x < 0 || loc.x >= cols_ || loc.y < 0 || loc.y >= rows_) {
-                throw std::out_of_range("Coordinates out of bounds");
-            }
-            auto start_index = loc.y * (cols_ * layers_) + loc.x * layers_;
-            return cell_proxy(&impl_[start_index], layers_);
+            check_bounds(loc.x, loc.y);
+            return cell_proxy(cell_ptr(loc.x, loc.y), layers_, layer_stride_);
         }
 
-        const std::span<const T> operator[](const coords& loc) const {
-            if (loc.x < 0 || loc.x >= cols_ || loc.y < 0 || loc.y >= rows_) {
-                throw std::out_of_range("Coordinates out of bounds");
-            }
-            auto start_index = loc.y * (cols_ * layers_) + loc.x * layers_;
-            return std::span<const T>(&impl_[start_index], layers_);
+        const_cell_proxy operator[](const coords& loc) const {
+            check_bounds(loc.x, loc.y);
+            return const_cell_proxy(cell_ptr(loc.x, loc.y), layers_, layer_stride_);
         }
 
         cell_proxy operator[](int x, int y) {
             return (*this)[coords{ x, y }];
         }
 
-        const std::span<const T> operator[](int x, int y) const {
+        const_cell_proxy operator[](int x, int y) const {
             return (*this)[coords{ x, y }];
         }
 
+        // unchecked access to the first layer of the cell at (x, y). Layer z of the cell
+        // is layer_stride() elements further on.
+        T* cell_ptr(int x, int y) {
+            return impl_.data() + index(x, y, 0);
+        }
+
+        const T* cell_ptr(int x, int y) const {
+            return impl_.data() + index(x, y, 0);
+        }
+
+        // the distance between horizontally adjacent cells, between vertically adjacent
+        // cells, and between the layers of a cell. In the tiled layout these only hold
+        // within a tile.
+        std::ptrdiff_t cell_stride() const {
+            return cell_stride_;
+        }
+
+        std::ptrdiff_t row_stride() const {
+            return row_stride_;
+        }
+
+        std::ptrdiff_t layer_stride() const {
+            return layer_stride_;
+        }
+
+        // the number of cells starting at column x that lie at a constant stride.
+        int contiguous_cells(int x) const {
+            if (layout_ == storage_layout::tiled) {
+                return std::min(k_tile_size - x % k_tile_size, cols_ - x);
+            }
+            return cols_ - x;
+        }
+
+        storage_layout layout() const {
+            return layout_;
+        }
+
+        // the storage in memory order, including the padding of partial tiles.
+        std::span<T> entries() {
+            return impl_;
+        }
+
+        std::span<const T> entries() const {
+            return impl_;
+        }
+
         void* data() const {
             return reinterpret_cast<void*>(const_cast<T*>(impl_.data()));
         }
@@ -154,4 +248,4 @@ namespace flo {
 
     };
 
-}
\ No newline at end of file
+}
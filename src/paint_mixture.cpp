@@ -1,11 +1,21 @@
 #include "paint_mixture.hpp"
+#include "simd.hpp"
+#include <format>
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
 
 /*------------------------------------------------------------------------------------------------*/
 
+namespace {
+    constexpr int k_width = flo::paint_mixture::capacity;
+}
 
 double flo::volume(const paint_mixture& p)
+{
+    return volume(std::span<const paint_value>(p));
+}
+
+double flo::volume(std::span<const paint_value> p)
 {
     return r::fold_left(p, 0.0, std::plus<>());
 }
@@ -26,25 +36,14 @@ flo::paint_mixture flo::normalize(const paint_mixture& p) {
     return norm;
 }
 
-
 flo::paint_mixture flo::operator*(double k, const paint_mixture& p) {
     auto prod = p;
-    for (auto& val : prod) {
-        val *= k;
-    }
+    simd::scale(prod.data(), static_cast<paint_value>(k), p.data(), k_width);
     return prod;
 }
 
 flo::paint_mixture& flo::operator+=(flo::paint_mixture& paint_lhs, const flo::paint_mixture& paint_rhs) {
-    auto new_mixture = rv::zip(paint_lhs, paint_rhs) |
-        rv::transform(
-            [&](const auto& pair) {
-                const auto& [lhs, rhs] = pair;
-                return lhs + rhs;
-            }
-        ) | r::to<std::vector>();
-
-    paint_lhs = std::move(new_mixture);
+    simd::add(paint_lhs.data(), paint_lhs.data(), paint_rhs.data(), k_width);
     return paint_lhs;
 }
 
@@ -64,8 +63,72 @@ flo::paint_mixture flo::operator-(const paint_mixture& lhs, const paint_mixture&
     return difference;
 }
 
+// each run kernel has a fast path for interleaved cells, whose layers are contiguous, and
+// a strided path that sweeps one layer at a time across the run, which is unit-stride when
+// the layers are stored as planes. Both round identically.
+
+void flo::blend_run(const cell_run& run, const double* weights, const paint_mixture& paint) {
+    auto [cells, cell_stride, layer_stride, layers, n] = run;
+    if (layer_stride == 1) {
+        for (int i = 0; i < n; ++i) {
+            paint_value* cell = cells + i * cell_stride;
+            simd::axpby(cell, static_cast<paint_value>(1.0 - weights[i]), cell,
+                static_cast<paint_value>(weights[i]), paint.data(), layers);
+        }
+        return;
+    }
+    for (int z = 0; z < layers; ++z) {
+        paint_value* layer = cells + z * layer_stride;
+        paint_value v = paint[z];
+        for (int i = 0; i < n; ++i) {
+            paint_value& cell = layer[i * cell_stride];
+            cell = static_cast<paint_value>(1.0 - weights[i]) * cell +
+                static_cast<paint_value>(weights[i]) * v;
+        }
+    }
+}
+
+void flo::add_scaled_run(const cell_run& run, const double* weights, const paint_mixture& paint) {
+    auto [cells, cell_stride, layer_stride, layers, n] = run;
+    if (layer_stride == 1) {
+        for (int i = 0; i < n; ++i) {
+            simd::axpy(
+                cells + i * cell_stride, static_cast<paint_value>(weights[i]), paint.data(), layers
+            );
+        }
+        return;
+    }
+    for (int z = 0; z < layers; ++z) {
+        paint_value* layer = cells + z * layer_stride;
+        paint_value v = paint[z];
+        for (int i = 0; i < n; ++i) {
+            layer[i * cell_stride] += static_cast<paint_value>(weights[i]) * v;
+        }
+    }
+}
+
+void flo::add_scaled_run(paint_mixture& sum, const const_cell_run& run, const double* weights) {
+    auto [cells, cell_stride, layer_stride, layers, n] = run;
+    if (layer_stride == 1) {
+        for (int i = 0; i < n; ++i) {
+            simd::axpy(
+                sum.data(), static_cast<paint_value>(weights[i]), cells + i * cell_stride, layers
+            );
+        }
+        return;
+    }
+    for (int z = 0; z < layers; ++z) {
+        const paint_value* layer = cells + z * layer_stride;
+        paint_value total = sum[z];
+        for (int i = 0; i < n; ++i) {
+            total += static_cast<paint_value>(weights[i]) * layer[i * cell_stride];
+        }
+        sum[z] = total;
+    }
+}
+
 flo::paint_mixture flo::make_one_color_paint(int palette_sz, int color_index, double volume) {
-    auto mixture = std::vector<double>(palette_sz, 0.0);
+    auto mixture = paint_mixture(palette_sz, 0.0);
     mixture[color_index] = 1.0;
     return mixture;
 }
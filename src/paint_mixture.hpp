@@ -1,15 +1,90 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include "types.hpp"
 #include "pigment.hpp"
 #include <unordered_map>
 
+#ifndef FLO_MAX_PALETTE_SIZE
+#define FLO_MAX_PALETTE_SIZE 16
+#endif
+
 /*------------------------------------------------------------------------------------------------*/
 
 namespace flo {
 
-    using paint_mixture = std::vector<double>;
+    constexpr int k_max_palette_size = FLO_MAX_PALETTE_SIZE;
+
+    // the type in which paint volumes are stored and mixed. Single precision halves the
+    // memory and bandwidth of large canvases.
+#ifdef FLO_FLOAT_CANVAS
+    using paint_value = float;
+#else
+    using paint_value = double;
+#endif
+
+    // the volume of each palette color in some quantity of paint. Values are stored
+    // inline in an array sized for the largest supported palette and the unused tail is
+    // kept at zero, so mixtures never allocate and arithmetic over them can always run
+    // the full compile-time width.
+
+    template<typename T, int N>
+    class basic_paint_mixture {
+        alignas(32) std::array<T, N> vals_;
+        int size_;
+
+    public:
+        using value_type = T;
+        static constexpr int capacity = N;
+
+        basic_paint_mixture() : vals_{}, size_(0) {}
+
+        explicit basic_paint_mixture(int sz, T v = T{}) : vals_{}, size_(sz) {
+            if (sz > N) {
+                throw std::invalid_argument("paint mixture exceeds the maximum palette size");
+            }
+            std::fill_n(vals_.begin(), sz, v);
+        }
+
+        basic_paint_mixture(std::span<const T> vals) : basic_paint_mixture(
+                static_cast<int>(vals.size())) {
+            std::copy(vals.begin(), vals.end(), vals_.begin());
+        }
+
+        basic_paint_mixture(std::initializer_list<T> vals) :
+            basic_paint_mixture(std::span<const T>(vals.begin(), vals.size())) {
+        }
+
+        basic_paint_mixture(const std::vector<T>& vals) :
+            basic_paint_mixture(std::span<const T>(vals)) {
+        }
+
+        int size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        T* data() { return vals_.data(); }
+        const T* data() const { return vals_.data(); }
+
+        T* begin() { return vals_.data(); }
+        T* end() { return vals_.data() + size_; }
+        const T* begin() const { return vals_.data(); }
+        const T* end() const { return vals_.data() + size_; }
+
+        T& operator[](int i) { return vals_[i]; }
+        T operator[](int i) const { return vals_[i]; }
+
+        operator std::span<const T>() const {
+            return { vals_.data(), static_cast<size_t>(size_) };
+        }
+    };
+
+    using paint_mixture = basic_paint_mixture<paint_value, k_max_palette_size>;
 
     paint_mixture operator*(double k, const paint_mixture& paint);
     paint_mixture& operator+=(paint_mixture& lhs, const paint_mixture& rhs);
@@ -18,9 +93,29 @@ namespace flo {
     paint_mixture operator-(const paint_mixture& lhs, const paint_mixture& rhs);
 
     double volume(const paint_mixture& p);
+    double volume(std::span<const paint_value> p);
     void normalize_in_place(paint_mixture& p);
     paint_mixture normalize(const paint_mixture& p);
 
+    // n adjacent canvas cells, where layer z of cell i is at
+    // cells[i * cell_stride + z * layer_stride].
+    template<typename T>
+    struct basic_cell_run {
+        T* cells;
+        std::ptrdiff_t cell_stride;
+        std::ptrdiff_t layer_stride;
+        int layers;
+        int n;
+    };
+
+    using cell_run = basic_cell_run<paint_value>;
+    using const_cell_run = basic_cell_run<const paint_value>;
+
+    // kernels over a run of cells, where cell i is weighted by weights[i].
+    void blend_run(const cell_run& run, const double* weights, const paint_mixture& paint);
+    void add_scaled_run(const cell_run& run, const double* weights, const paint_mixture& paint);
+    void add_scaled_run(paint_mixture& sum, const const_cell_run& run, const double* weights);
+
     paint_mixture make_one_color_paint(int palette_sz, int color_index, double volume);
     std::string display(const paint_mixture& p);
-}
\ No newline at end of file
+}
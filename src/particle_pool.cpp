@@ -0,0 +1,138 @@
+#include "particle_pool.hpp"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+    constexpr double k_no_lifespan = std::numeric_limits<double>::infinity();
+}
+
+flo::particle_pool::particle_pool(int history_capacity) :
+    history_capacity_(std::max(history_capacity, 1)),
+    size_(0)
+{
+}
+
+int flo::particle_pool::size() const {
+    return size_;
+}
+
+int flo::particle_pool::history_capacity() const {
+    return history_capacity_;
+}
+
+flo::point* flo::particle_pool::history_buffer(int i) {
+    return history_.data() + 2 * history_capacity_ * i;
+}
+
+const flo::point* flo::particle_pool::history_buffer(int i) const {
+    return history_.data() + 2 * history_capacity_ * i;
+}
+
+int flo::particle_pool::add(const point& loc, std::optional<double> lifespan) {
+    int i = size_++;
+    if (i == static_cast<int>(elapsed_.size())) {
+        elapsed_.push_back(0.0);
+        lifespan_.push_back(k_no_lifespan);
+        stroke_done_.push_back(0);
+        paint_.emplace_back();
+        history_.resize(history_.size() + 2 * history_capacity_);
+        history_head_.push_back(0);
+        history_len_.push_back(0);
+        rng_.emplace_back();
+    }
+    elapsed_[i] = 0.0;
+    lifespan_[i] = lifespan.value_or(k_no_lifespan);
+    stroke_done_[i] = 0;
+    history_head_[i] = 0;
+    history_len_[i] = 0;
+    rng_[i] = new_rng_stream();
+    push_position(i, loc);
+    return i;
+}
+
+void flo::particle_pool::push_position(int i, const point& loc) {
+    auto* buffer = history_buffer(i);
+    int& head = history_head_[i];
+    buffer[head] = loc;
+    buffer[head + history_capacity_] = loc;
+    head = (head + 1) % history_capacity_;
+    history_len_[i] = std::min(history_len_[i] + 1, history_capacity_);
+}
+
+void flo::particle_pool::apply_brush(int i, canvas& canv, const brush_params& params) {
+    auto lifespan = this->lifespan(i);
+    flo::apply_brush(canv, params, paint_[i], position(i), elapsed_[i], lifespan);
+    if (lifespan && elapsed_[i] >= *lifespan) {
+        stroke_done_[i] = 1;
+    }
+}
+
+flo::point flo::particle_pool::position(int i) const {
+    int newest = (history_head_[i] + history_capacity_ - 1) % history_capacity_;
+    return history_buffer(i)[newest];
+}
+
+std::span<const flo::point> flo::particle_pool::history(int i) const {
+    int len = history_len_[i];
+    int oldest = (history_head_[i] + history_capacity_ - len) % history_capacity_;
+    return { history_buffer(i) + oldest, static_cast<size_t>(len) };
+}
+
+double flo::particle_pool::elapsed(int i) const {
+    return elapsed_[i];
+}
+
+double& flo::particle_pool::elapsed(int i) {
+    return elapsed_[i];
+}
+
+std::optional<double> flo::particle_pool::lifespan(int i) const {
+    if (lifespan_[i] == k_no_lifespan) {
+        return {};
+    }
+    return lifespan_[i];
+}
+
+bool flo::particle_pool::is_stroke_done(int i) const {
+    return stroke_done_[i];
+}
+
+flo::paint_mixture& flo::particle_pool::paint(int i) {
+    return paint_[i];
+}
+
+const flo::paint_mixture& flo::particle_pool::paint(int i) const {
+    return paint_[i];
+}
+
+flo::rng_stream& flo::particle_pool::rng(int i) {
+    return rng_[i];
+}
+
+void flo::particle_pool::resize(int n) {
+    elapsed_.resize(n);
+    lifespan_.resize(n);
+    stroke_done_.resize(n);
+    paint_.resize(n);
+    history_.resize(static_cast<size_t>(2 * history_capacity_) * n);
+    history_head_.resize(n);
+    history_len_.resize(n);
+    rng_.resize(n);
+    size_ = n;
+}
+
+void flo::particle_pool::swap_particles(int i, int j) {
+    std::swap(elapsed_[i], elapsed_[j]);
+    std::swap(lifespan_[i], lifespan_[j]);
+    std::swap(stroke_done_[i], stroke_done_[j]);
+    std::swap(paint_[i], paint_[j]);
+    std::swap_ranges(
+        history_buffer(i), history_buffer(i) + 2 * history_capacity_, history_buffer(j)
+    );
+    std::swap(history_head_[i], history_head_[j]);
+    std::swap(history_len_[i], history_len_[j]);
+    std::swap(rng_[i], rng_[j]);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "types.hpp"
+#include "brush.hpp"
+#include "canvas.hpp"
+#include "paint_mixture.hpp"
+#include "random.hpp"
+#include <optional>
+#include <span>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // paint particles stored as parallel arrays. Each particle's recent positions live in
+    // a fixed-capacity ring buffer in which every position is written twice, capacity
+    // slots apart, so the retained history is always one contiguous span. Slots are
+    // recycled rather than freed, so once the pool has reached its working size adding,
+    // stepping and removing particles does not allocate. Every particle added gets its
+    // own random stream, so particles can be stepped in parallel reproducibly.
+
+    class particle_pool {
+        int history_capacity_;
+        int size_;
+        std::vector<double> elapsed_;
+        std::vector<double> lifespan_;
+        std::vector<uint8_t> stroke_done_;
+        std::vector<paint_mixture> paint_;
+        std::vector<point> history_;
+        std::vector<int> history_head_;
+        std::vector<int> history_len_;
+        std::vector<rng_stream> rng_;
+
+        point* history_buffer(int i);
+        const point* history_buffer(int i) const;
+        void swap_particles(int i, int j);
+
+    public:
+        particle_pool(int history_capacity = 1);
+
+        int size() const;
+        int history_capacity() const;
+
+        int add(const point& loc, std::optional<double> lifespan);
+        void push_position(int i, const point& loc);
+        void apply_brush(int i, canvas& canv, const brush_params& params);
+
+        point position(int i) const;
+        std::span<const point> history(int i) const;
+        double elapsed(int i) const;
+        double& elapsed(int i);
+        std::optional<double> lifespan(int i) const;
+        bool is_stroke_done(int i) const;
+        paint_mixture& paint(int i);
+        const paint_mixture& paint(int i) const;
+        rng_stream& rng(int i);
+
+        // for checkpoints: visit_arrays() calls f(array, entries_per_particle) with each
+        // array of per-particle state, the first size() particles' entries being live,
+        // and resize() makes the pool hold n particles whose state is then written
+        // through visit_arrays().
+        void resize(int n);
+
+        template<typename F>
+        void visit_arrays(F&& f) {
+            f(elapsed_, 1);
+            f(lifespan_, 1);
+            f(stroke_done_, 1);
+            f(paint_, 1);
+            f(history_, 2 * history_capacity_);
+            f(history_head_, 1);
+            f(history_len_, 1);
+            f(rng_, 1);
+        }
+
+        template<typename F>
+        void visit_arrays(F&& f) const {
+            f(elapsed_, 1);
+            f(lifespan_, 1);
+            f(stroke_done_, 1);
+            f(paint_, 1);
+            f(history_, 2 * history_capacity_);
+            f(history_head_, 1);
+            f(history_len_, 1);
+            f(rng_, 1);
+        }
+
+        // removes every particle for which pred returns false, preserving the order of
+        // the survivors.
+        template<typename Pred>
+        void retain_if(Pred&& pred) {
+            int survivors = 0;
+            for (int i = 0; i < size_; ++i) {
+                if (pred(i)) {
+                    if (i != survivors) {
+                        swap_particles(i, survivors);
+                    }
+                    ++survivors;
+                }
+            }
+            size_ = survivors;
+        }
+    };
+
+}
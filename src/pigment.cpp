@@ -13,6 +13,14 @@ namespace rv = std::ranges::views;
 namespace {
     constexpr float k_eps = 0.000005f;
     constexpr float k_mult = 1.0f / k_eps;
+
+    float clamp01(float x) {
+        return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+    }
+
+    int to_channel(float x) {
+        return static_cast<int>(clamp01(x) * 255.0f + 0.5f);
+    }
 }
 
 flo::pigment flo::rgb_to_pigment(uint8_t r, uint8_t g, uint8_t b) {
@@ -92,6 +100,64 @@ flo::pigment flo::mix_paint(const pigment_map<double>& pigments) {
     return mixed_pigment;
 }
 
+void flo::pigments_to_rgb(const pigment_batch& batch, int n, rgb_color* colors) {
+    // mixbox's latent to rgb polynomial, with its terms summed in the same order so that
+    // each color is exactly the one mixbox_latent_to_rgb would give.
+    int red[pigment_batch::k_size];
+    int green[pigment_batch::k_size];
+    int blue[pigment_batch::k_size];
+    const auto& [p0, p1, p2, p3, p4, p5, p6] = batch.impl;
+    for (int j = 0; j < n; ++j) {
+        const float c0 = p0[j];
+        const float c1 = p1[j];
+        const float c2 = p2[j];
+        const float c3 = p3[j];
+        const float c00 = c0 * c0;
+        const float c11 = c1 * c1;
+        const float c22 = c2 * c2;
+        const float c33 = c3 * c3;
+        const float c01 = c0 * c1;
+        const float c02 = c0 * c2;
+        const float c12 = c1 * c2;
+
+        float r = 0.0f;
+        float g = 0.0f;
+        float b = 0.0f;
+        float w;
+        w = c0 * c00; r += +0.07717053f * w; g += +0.02826978f * w; b += +0.24832992f * w;
+        w = c1 * c11; r += +0.95912302f * w; g += +0.80256528f * w; b += +0.03561839f * w;
+        w = c2 * c22; r += +0.74683774f * w; g += +0.04868586f * w; b += +0.00000000f * w;
+        w = c3 * c33; r += +0.99518138f * w; g += +0.99978149f * w; b += +0.99704802f * w;
+        w = c00 * c1; r += +0.04819146f * w; g += +0.83363781f * w; b += +0.32515377f * w;
+        w = c01 * c1; r += -0.68146950f * w; g += +1.46107803f * w; b += +1.06980936f * w;
+        w = c00 * c2; r += +0.27058419f * w; g += -0.15324870f * w; b += +1.98735057f * w;
+        w = c02 * c2; r += +0.80478189f * w; g += +0.67093710f * w; b += +0.18424500f * w;
+        w = c00 * c3; r += -0.35031003f * w; g += +1.37855826f * w; b += +3.68865000f * w;
+        w = c0 * c33; r += +1.05128046f * w; g += +1.97815239f * w; b += +2.82989073f * w;
+        w = c11 * c2; r += +3.21607125f * w; g += +0.81270228f * w; b += +1.03384539f * w;
+        w = c1 * c22; r += +2.78893374f * w; g += +0.41565549f * w; b += -0.04487295f * w;
+        w = c11 * c3; r += +3.02162577f * w; g += +2.55374103f * w; b += +0.32766114f * w;
+        w = c1 * c33; r += +2.95124691f * w; g += +2.81201112f * w; b += +1.17578442f * w;
+        w = c22 * c3; r += +2.82677043f * w; g += +0.79933038f * w; b += +1.81715262f * w;
+        w = c2 * c33; r += +2.99691099f * w; g += +1.22593053f * w; b += +1.80653661f * w;
+        w = c01 * c2; r += +1.87394106f * w; g += +2.05027182f * w; b += -0.29835996f * w;
+        w = c01 * c3; r += +2.56609566f * w; g += +7.03428198f * w; b += +0.62575374f * w;
+        w = c02 * c3; r += +4.08329484f * w; g += -1.40408358f * w; b += +2.14995522f * w;
+        w = c12 * c3; r += +6.00078678f * w; g += +2.55552042f * w; b += +1.90739502f * w;
+
+        red[j] = to_channel(r + p4[j]);
+        green[j] = to_channel(g + p5[j]);
+        blue[j] = to_channel(b + p6[j]);
+    }
+    for (int j = 0; j < n; ++j) {
+        colors[j] = {
+            static_cast<uint8_t>(red[j]),
+            static_cast<uint8_t>(green[j]),
+            static_cast<uint8_t>(blue[j])
+        };
+    }
+}
+
 bool flo::pigment::operator==(const pigment& p) const {
 
     static const auto approx_eql = [](float u, float v)->bool {
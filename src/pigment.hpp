@@ -32,4 +32,14 @@ namespace flo {
     pigment mix_pigments(const pigment& a, double a_vol, const pigment& b, double b_vol);
     pigment mix_paint(const pigment_map<double>& pigments);
 
+    // pigments stored component by component, so that work over a batch of them
+    // vectorizes.
+    struct pigment_batch {
+        static constexpr int k_size = 64;
+        float impl[MIXBOX_LATENT_SIZE][k_size];
+    };
+
+    // the colors pigment_to_rgb gives for the first n pigments of the batch.
+    void pigments_to_rgb(const pigment_batch& batch, int n, rgb_color* colors);
+
 }
\ No newline at end of file
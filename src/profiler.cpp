@@ -0,0 +1,134 @@
+#include "profiler.hpp"
+#include "third-party/json.hpp"
+#include <array>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
+
+using json = nlohmann::json;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    // one thread's totals. Only the owning thread writes them, so updates are a relaxed
+    // load and store rather than a read-modify-write.
+    struct thread_totals {
+        std::array<std::atomic<uint64_t>, flo::profiler::k_max_entries> nanoseconds{};
+        std::array<std::atomic<uint64_t>, flo::profiler::k_max_entries> calls{};
+        std::array<std::atomic<uint64_t>, flo::profiler::k_max_entries> counts{};
+    };
+
+    void add(std::atomic<uint64_t>& total, uint64_t n) {
+        total.store(total.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct registry {
+        std::mutex mutex;
+        std::vector<std::string> timers;
+        std::vector<std::string> counters;
+        // totals outlive their threads so that work done by pools that have since been
+        // destroyed is still reported.
+        std::vector<std::unique_ptr<thread_totals>> threads;
+    };
+
+    registry& the_registry() {
+        static registry reg;
+        return reg;
+    }
+
+    thread_totals& this_thread_totals() {
+        thread_local thread_totals* totals = nullptr;
+        if (!totals) {
+            auto& reg = the_registry();
+            std::lock_guard lock(reg.mutex);
+            totals = reg.threads.emplace_back(std::make_unique<thread_totals>()).get();
+        }
+        return *totals;
+    }
+
+    int id_of(std::vector<std::string>& names, const char* name) {
+        auto& reg = the_registry();
+        std::lock_guard lock(reg.mutex);
+        for (int i = 0; i < static_cast<int>(names.size()); ++i) {
+            if (names[i] == name) {
+                return i;
+            }
+        }
+        if (names.size() == flo::profiler::k_max_entries) {
+            throw std::runtime_error("too many profiler entries");
+        }
+        names.push_back(name);
+        return static_cast<int>(names.size()) - 1;
+    }
+
+}
+
+std::atomic<bool> flo::profiler::enabled_ = false;
+
+void flo::profiler::enable() {
+    enabled_ = true;
+}
+
+int flo::profiler::timer_id(const char* name) {
+    return id_of(the_registry().timers, name);
+}
+
+int flo::profiler::counter_id(const char* name) {
+    return id_of(the_registry().counters, name);
+}
+
+void flo::profiler::add_time(int id, std::chrono::nanoseconds elapsed) {
+    auto& totals = this_thread_totals();
+    add(totals.nanoseconds[id], static_cast<uint64_t>(elapsed.count()));
+    add(totals.calls[id], 1);
+}
+
+void flo::profiler::add_count(int id, uint64_t n) {
+    add(this_thread_totals().counts[id], n);
+}
+
+void flo::profiler::write_report(const std::string& fname) {
+    auto& reg = the_registry();
+    std::lock_guard lock(reg.mutex);
+
+    json phases = json::object();
+    for (auto [id, name] : reg.timers | std::views::enumerate) {
+        uint64_t ns = 0;
+        uint64_t calls = 0;
+        for (const auto& totals : reg.threads) {
+            ns += totals->nanoseconds[id].load(std::memory_order_relaxed);
+            calls += totals->calls[id].load(std::memory_order_relaxed);
+        }
+        phases[name] = { { "seconds", static_cast<double>(ns) * 1e-9 }, { "calls", calls } };
+    }
+
+    json counters = json::object();
+    for (auto [id, name] : reg.counters | std::views::enumerate) {
+        uint64_t total = 0;
+        for (const auto& totals : reg.threads) {
+            total += totals->counts[id].load(std::memory_order_relaxed);
+        }
+        counters[name] = total;
+    }
+
+    // counters are also reported per simulation step where there are steps to divide by.
+    json report = { { "phases", phases }, { "counters", counters } };
+    if (counters.contains("steps") && counters["steps"].get<uint64_t>() > 0) {
+        auto steps = static_cast<double>(counters["steps"].get<uint64_t>());
+        json per_step = json::object();
+        for (const auto& [name, total] : counters.items()) {
+            per_step[name] = static_cast<double>(total.get<uint64_t>()) / steps;
+        }
+        report["per_step"] = per_step;
+    }
+
+    std::ofstream out(fname);
+    if (!out) {
+        throw std::runtime_error("unable to write " + fname);
+    }
+    out << report.dump(4) << '\n';
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // accumulates the time spent in named phases and the totals of named counters. Both
+    // are gathered only once the profiler has been enabled; until then each probe costs
+    // one relaxed load. Counts are kept per thread, so probes inside parallel loops do not
+    // contend, and are summed when the report is written. Building without FLO_PROFILING
+    // compiles the probes out entirely.
+
+    class profiler {
+        static std::atomic<bool> enabled_;
+
+    public:
+        static constexpr int k_max_entries = 64;
+
+        static void enable();
+
+        static bool enabled() {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        // the index of a named phase or counter, registering it on first use.
+        static int timer_id(const char* name);
+        static int counter_id(const char* name);
+
+        static void add_time(int id, std::chrono::nanoseconds elapsed);
+        static void add_count(int id, uint64_t n);
+
+        // writes the phase times and counter totals as JSON.
+        static void write_report(const std::string& fname);
+    };
+
+    class scoped_timer {
+        int id_;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+        explicit scoped_timer(int id) : id_(profiler::enabled() ? id : -1) {
+            if (id_ >= 0) {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        scoped_timer(const scoped_timer&) = delete;
+        scoped_timer& operator=(const scoped_timer&) = delete;
+
+        ~scoped_timer() {
+            if (id_ >= 0) {
+                profiler::add_time(id_, std::chrono::steady_clock::now() - start_);
+            }
+        }
+    };
+
+}
+
+#define FLO_PROFILE_CONCAT_AUX(a, b) a##b
+#define FLO_PROFILE_CONCAT(a, b) FLO_PROFILE_CONCAT_AUX(a, b)
+
+#ifdef FLO_PROFILING
+
+// times the rest of the enclosing scope as the phase name.
+#define FLO_PROFILE_SCOPE(name) \
+    static const int FLO_PROFILE_CONCAT(flo_timer_id_, __LINE__) = flo::profiler::timer_id(name); \
+    flo::scoped_timer FLO_PROFILE_CONCAT(flo_timer_, __LINE__)( \
+        FLO_PROFILE_CONCAT(flo_timer_id_, __LINE__))
+
+// adds n to the counter name.
+#define FLO_PROFILE_COUNT(name, n) \
+    do { \
+        if (flo::profiler::enabled()) { \
+            static const int flo_counter_id = flo::profiler::counter_id(name); \
+            flo::profiler::add_count(flo_counter_id, static_cast<uint64_t>(n)); \
+        } \
+    } while (false)
+
+#else
+
+#define FLO_PROFILE_SCOPE(name) static_cast<void>(0)
+#define FLO_PROFILE_COUNT(name, n) static_cast<void>(0)
+
+#endif
@@ -0,0 +1,78 @@
+#include "random.hpp"
+#include <random>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr uint64_t k_golden_gamma = 0x9e3779b97f4a7c15;
+
+    uint64_t splitmix64(uint64_t& state) {
+        uint64_t z = (state += k_golden_gamma);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    struct rng_streams {
+        uint64_t seed;
+        uint64_t next_stream;
+        flo::rng_stream main;
+
+        rng_streams(uint64_t s) : seed(s), next_stream(1), main(s, 0) {}
+    };
+
+    rng_streams& streams() {
+        static rng_streams streams(std::random_device{}());
+        return streams;
+    }
+
+}
+
+flo::rng_stream::rng_stream(uint64_t seed, uint64_t stream) :
+        spare_normal_(0.0),
+        has_spare_normal_(false) {
+    uint64_t stream_state = stream;
+    uint64_t state = seed ^ splitmix64(stream_state);
+    for (auto& word : state_) {
+        word = splitmix64(state);
+    }
+}
+
+int flo::rng_stream::uniform_int(int min, int max) {
+    uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(max) - min) + 1;
+    // rejecting the draws past the last whole multiple of range keeps every value
+    // equally likely.
+    uint64_t limit = std::numeric_limits<uint64_t>::max() -
+        std::numeric_limits<uint64_t>::max() % range;
+    uint64_t draw;
+    do {
+        draw = (*this)();
+    } while (draw >= limit);
+    return static_cast<int>(min + static_cast<int64_t>(draw % range));
+}
+
+void flo::seed_rng_streams(uint64_t seed) {
+    streams() = rng_streams(seed);
+}
+
+flo::rng_stream& flo::main_rng() {
+    return streams().main;
+}
+
+flo::rng_stream flo::new_rng_stream() {
+    auto& s = streams();
+    return rng_stream(s.seed, s.next_stream++);
+}
+
+flo::rng_streams_state flo::rng_streams_snapshot() {
+    const auto& s = streams();
+    return { s.seed, s.next_stream, s.main };
+}
+
+void flo::restore_rng_streams(const rng_streams_state& state) {
+    auto& s = streams();
+    s.seed = state.seed;
+    s.next_stream = state.next_stream;
+    s.main = state.main;
+}
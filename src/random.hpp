@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // a xoshiro256** generator. Each stream is seeded by hashing a global seed together
+    // with a stream number through SplitMix64, so streams handed out in a fixed order
+    // give the same draws however the work using them is spread over threads.
+
+    class rng_stream {
+        std::array<uint64_t, 4> state_;
+        double spare_normal_;
+        bool has_spare_normal_;
+
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+    public:
+        using result_type = uint64_t;
+
+        rng_stream(uint64_t seed = 0, uint64_t stream = 0);
+
+        static constexpr result_type min() {
+            return 0;
+        }
+
+        static constexpr result_type max() {
+            return std::numeric_limits<result_type>::max();
+        }
+
+        result_type operator()() {
+            const uint64_t result = rotl(state_[1] * 5, 7) * 9;
+            const uint64_t t = state_[1] << 17;
+            state_[2] ^= state_[0];
+            state_[3] ^= state_[1];
+            state_[1] ^= state_[2];
+            state_[0] ^= state_[3];
+            state_[2] ^= t;
+            state_[3] = rotl(state_[3], 45);
+            return result;
+        }
+
+        // uniform in [0, 1).
+        double uniform() {
+            return static_cast<double>((*this)() >> 11) * 0x1.0p-53;
+        }
+
+        double uniform(double low, double high) {
+            return low + (high - low) * uniform();
+        }
+
+        // uniform over [min, max] inclusive.
+        int uniform_int(int min, int max);
+
+        // Box-Muller, which yields normals in pairs; the second is kept for the next call.
+        double normal(double mean, double stddev) {
+            if (has_spare_normal_) {
+                has_spare_normal_ = false;
+                return mean + stddev * spare_normal_;
+            }
+            double radius = std::sqrt(-2.0 * std::log(1.0 - uniform()));
+            double theta = 2.0 * std::numbers::pi * uniform();
+            spare_normal_ = radius * std::sin(theta);
+            has_spare_normal_ = true;
+            return mean + stddev * radius * std::cos(theta);
+        }
+    };
+
+    // seeds the main stream and every stream made after the call. Unless this is called
+    // the seed comes from std::random_device.
+    void seed_rng_streams(uint64_t seed);
+
+    // the stream used for draws made serially, such as spawning particles.
+    rng_stream& main_rng();
+
+    // the seed, the main stream and the number of the next stream to be made, which
+    // together determine every later draw, for checkpoints.
+    struct rng_streams_state {
+        uint64_t seed;
+        uint64_t next_stream;
+        rng_stream main;
+    };
+
+    rng_streams_state rng_streams_snapshot();
+    void restore_rng_streams(const rng_streams_state& state);
+
+    // a stream independent of every other. Streams are numbered in the order they are
+    // made, so they must be made from one thread for runs to be reproducible.
+    rng_stream new_rng_stream();
+
+}
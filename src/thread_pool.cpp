@@ -0,0 +1,103 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <utility>
+
+/*------------------------------------------------------------------------------------------------*/
+
+flo::thread_pool::thread_pool(int num_threads) :
+        task_(nullptr),
+        next_index_(0),
+        count_(0),
+        pending_workers_(0),
+        generation_(0),
+        stopping_(false) {
+    num_threads = resolve_thread_count(num_threads);
+    for (int i = 1; i < num_threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+flo::thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+    workers_.clear();
+}
+
+int flo::thread_pool::num_threads() const {
+    return static_cast<int>(workers_.size()) + 1;
+}
+
+void flo::thread_pool::parallel_for(int count, const std::function<void(int)>& fn) {
+    if (workers_.empty() || count <= 1) {
+        for (int i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        task_ = &fn;
+        count_ = count;
+        next_index_ = 0;
+        pending_workers_ = static_cast<int>(workers_.size());
+        error_ = nullptr;
+        ++generation_;
+    }
+    work_ready_.notify_all();
+
+    drain();
+
+    std::unique_lock lock(mutex_);
+    work_done_.wait(lock, [this]() { return pending_workers_ == 0; });
+    task_ = nullptr;
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+void flo::thread_pool::drain() {
+    for (int i = next_index_++; i < count_; i = next_index_++) {
+        try {
+            (*task_)(i);
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+}
+
+void flo::thread_pool::worker_loop() {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            work_ready_.wait(lock,
+                [&]() { return stopping_ || generation_ != seen_generation; }
+            );
+            if (stopping_) {
+                return;
+            }
+            seen_generation = generation_;
+        }
+
+        drain();
+
+        std::lock_guard lock(mutex_);
+        if (--pending_workers_ == 0) {
+            work_done_.notify_one();
+        }
+    }
+}
+
+int flo::resolve_thread_count(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
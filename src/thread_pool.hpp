@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    // a fixed set of worker threads that execute index-parallel loops. The calling
+    // thread participates in each loop, so a pool of n threads spawns n-1 workers.
+
+    class thread_pool {
+        std::vector<std::jthread> workers_;
+        std::mutex mutex_;
+        std::condition_variable work_ready_;
+        std::condition_variable work_done_;
+        const std::function<void(int)>* task_;
+        std::atomic<int> next_index_;
+        int count_;
+        int pending_workers_;
+        uint64_t generation_;
+        bool stopping_;
+        std::exception_ptr error_;
+
+        void worker_loop();
+        void drain();
+
+    public:
+        explicit thread_pool(int num_threads = 1);
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+        ~thread_pool();
+
+        int num_threads() const;
+        void parallel_for(int count, const std::function<void(int)>& fn);
+    };
+
+    int resolve_thread_count(int requested);
+}
@@ -0,0 +1,181 @@
+#include "tile_store.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace r = std::ranges;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    int num_tiles(int cols, int rows) {
+        constexpr int k_tile_size = flo::tile_store::k_tile_size;
+        return ((cols + k_tile_size - 1) / k_tile_size) * ((rows + k_tile_size - 1) / k_tile_size);
+    }
+
+    size_t tile_bytes(int layers) {
+        return static_cast<size_t>(flo::tile_store::k_tile_area) * layers * sizeof(flo::paint_value);
+    }
+
+}
+
+flo::tile_store::tile_store(int cols, int rows, int layers, const paging_params& params) :
+        filename_(params.filename),
+        cols_(cols),
+        rows_(rows),
+        layers_(layers),
+        tiles_x_((cols + k_tile_size - 1) / k_tile_size),
+        tile_values_(static_cast<std::ptrdiff_t>(k_tile_area) * layers),
+        // a new file reads as zeros, and on most file systems takes no space until written.
+        file_(mapped_file::create(params.filename, tile_bytes(layers) * num_tiles(cols, rows))),
+        stored_(num_tiles(cols, rows), 0),
+        newest_(-1),
+        oldest_(-1),
+        num_resident_(0),
+        current_tile_(-1),
+        stats_{ 0, 0, 0, 0, 0 } {
+    auto budget = static_cast<size_t>(params.max_megabytes * 1024.0 * 1024.0);
+    int capacity = static_cast<int>(
+        std::clamp(budget / tile_bytes(layers), size_t{ 1 }, stored_.size())
+    );
+    slots_.resize(tile_values_ * capacity);
+    slot_of_tile_.assign(stored_.size(), -1);
+    tile_in_slot_.assign(capacity, -1);
+    dirty_.assign(capacity, 0);
+    newer_.assign(capacity, -1);
+    older_.assign(capacity, -1);
+}
+
+flo::tile_store::~tile_store() {
+    // the mapping is released first, as an open file cannot be deleted on every platform.
+    {
+        auto released = std::move(file_);
+    }
+    std::error_code ec;
+    std::filesystem::remove(filename_, ec);
+}
+
+std::span<flo::paint_value> flo::tile_store::file_tile(int tile) const {
+    auto* values = reinterpret_cast<paint_value*>(file_.bytes().data());
+    return { values + tile * tile_values_, static_cast<size_t>(tile_values_) };
+}
+
+flo::paint_value* flo::tile_store::slot_ptr(int slot) const {
+    return slots_.data() + slot * tile_values_;
+}
+
+void flo::tile_store::unlink(int slot) const {
+    (older_[slot] >= 0 ? newer_[older_[slot]] : oldest_) = newer_[slot];
+    (newer_[slot] >= 0 ? older_[newer_[slot]] : newest_) = older_[slot];
+    newer_[slot] = -1;
+    older_[slot] = -1;
+}
+
+void flo::tile_store::make_newest(int slot) const {
+    older_[slot] = newest_;
+    newer_[slot] = -1;
+    if (newest_ >= 0) {
+        newer_[newest_] = slot;
+    } else {
+        oldest_ = slot;
+    }
+    newest_ = slot;
+}
+
+void flo::tile_store::write_back(int slot) const {
+    int tile = tile_in_slot_[slot];
+    if (!dirty_[slot]) {
+        return;
+    }
+    auto dest = file_tile(tile);
+    std::memcpy(dest.data(), slot_ptr(slot), dest.size_bytes());
+    // the file keeps what was written, so the pages need not stay in memory too.
+    file_.release_pages(tile * dest.size_bytes(), dest.size_bytes());
+    stored_[tile] = 1;
+    dirty_[slot] = 0;
+    ++stats_.write_backs;
+}
+
+void flo::tile_store::page_in(int tile) const {
+    current_tile_ = tile;
+    int slot = slot_of_tile_[tile];
+    if (slot >= 0) {
+        ++stats_.hits;
+        if (slot != newest_) {
+            unlink(slot);
+            make_newest(slot);
+        }
+        return;
+    }
+
+    FLO_PROFILE_SCOPE("tile_paging");
+    ++stats_.misses;
+    if (num_resident_ < static_cast<int>(tile_in_slot_.size())) {
+        slot = num_resident_++;
+    } else {
+        slot = oldest_;
+        write_back(slot);
+        slot_of_tile_[tile_in_slot_[slot]] = -1;
+        unlink(slot);
+    }
+
+    if (stored_[tile]) {
+        auto source = file_tile(tile);
+        std::memcpy(slot_ptr(slot), source.data(), source.size_bytes());
+        file_.release_pages(tile * source.size_bytes(), source.size_bytes());
+    } else {
+        std::fill_n(slot_ptr(slot), tile_values_, paint_value{ 0 });
+    }
+    slot_of_tile_[tile] = slot;
+    tile_in_slot_[slot] = tile;
+    dirty_[slot] = 0;
+    make_newest(slot);
+}
+
+int flo::tile_store::cols() const {
+    return cols_;
+}
+
+int flo::tile_store::rows() const {
+    return rows_;
+}
+
+int flo::tile_store::layers() const {
+    return layers_;
+}
+
+flo::tile_store_stats flo::tile_store::stats() const {
+    auto stats = stats_;
+    stats.resident = num_resident_;
+    stats.capacity = static_cast<int>(tile_in_slot_.size());
+    return stats;
+}
+
+std::span<const flo::paint_value> flo::tile_store::entries() const {
+    for (int slot = 0; slot < num_resident_; ++slot) {
+        write_back(slot);
+    }
+    auto bytes = file_.bytes();
+    return {
+        reinterpret_cast<const paint_value*>(bytes.data()), bytes.size() / sizeof(paint_value)
+    };
+}
+
+std::span<flo::paint_value> flo::tile_store::entries() {
+    for (int slot = 0; slot < num_resident_; ++slot) {
+        write_back(slot);
+        slot_of_tile_[tile_in_slot_[slot]] = -1;
+        tile_in_slot_[slot] = -1;
+    }
+    r::fill(newer_, -1);
+    r::fill(older_, -1);
+    newest_ = -1;
+    oldest_ = -1;
+    num_resident_ = 0;
+    current_tile_ = -1;
+    r::fill(stored_, 1);
+    auto bytes = file_.bytes();
+    return { reinterpret_cast<paint_value*>(bytes.data()), bytes.size() / sizeof(paint_value) };
+}
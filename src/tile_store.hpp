@@ -0,0 +1,127 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "matrix_3d.hpp"
+#include "paint_mixture.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace flo {
+
+    struct paging_params {
+        std::string filename;
+        double max_megabytes;
+    };
+
+    struct tile_store_stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t write_backs;
+        int resident;
+        int capacity;
+    };
+
+    // the cells of a canvas too large to hold in memory. They are laid out as in the tiled
+    // layout of matrix_3d in a file mapped into memory, and tiles are copied into a fixed
+    // number of resident slots, max_megabytes worth but at least one, as they are accessed.
+    // When the slots are full the least recently used tile is written back, if it has been
+    // written to, to make room. Tiles that have never been written back are blank and are
+    // not read from the file at all. The file is deleted with the store.
+    //
+    // A pointer to a cell is good until another tile is accessed, which may evict its tile.
+    // Reading pages tiles in too, so the store is not safe to use from several threads.
+
+    class tile_store {
+        std::string filename_;
+        int cols_;
+        int rows_;
+        int layers_;
+        int tiles_x_;
+        std::ptrdiff_t tile_values_;
+
+        // paging is invisible to readers, so everything it touches is mutable. Slots are
+        // kept in least recently used order as a doubly linked list from oldest_ to newest_.
+        mutable mapped_file file_;
+        mutable std::vector<uint8_t> stored_;
+        mutable std::vector<paint_value> slots_;
+        mutable std::vector<int> slot_of_tile_;
+        mutable std::vector<int> tile_in_slot_;
+        mutable std::vector<uint8_t> dirty_;
+        mutable std::vector<int> newer_;
+        mutable std::vector<int> older_;
+        mutable int newest_;
+        mutable int oldest_;
+        mutable int num_resident_;
+        mutable int current_tile_;
+        mutable tile_store_stats stats_;
+
+        std::span<paint_value> file_tile(int tile) const;
+        paint_value* slot_ptr(int slot) const;
+        void unlink(int slot) const;
+        void make_newest(int slot) const;
+        void write_back(int slot) const;
+        void page_in(int tile) const;
+
+        paint_value* tile_ptr(int x, int y) const {
+            int tile = (y / k_tile_size) * tiles_x_ + x / k_tile_size;
+            if (tile != current_tile_) {
+                page_in(tile);
+            } else {
+                ++stats_.hits;
+            }
+            return slot_ptr(slot_of_tile_[tile]) +
+                (y % k_tile_size) * k_tile_size + (x % k_tile_size);
+        }
+
+    public:
+        static constexpr int k_tile_size = matrix_3d<paint_value>::k_tile_size;
+        static constexpr int k_tile_area = matrix_3d<paint_value>::k_tile_area;
+
+        tile_store(int cols, int rows, int layers, const paging_params& params);
+        tile_store(const tile_store&) = delete;
+        tile_store& operator=(const tile_store&) = delete;
+        ~tile_store();
+
+        // the first layer of the cell at (x, y), the writable version marking its tile as
+        // needing to be written back.
+        paint_value* cell_ptr(int x, int y) {
+            auto* cell = tile_ptr(x, y);
+            dirty_[slot_of_tile_[current_tile_]] = 1;
+            return cell;
+        }
+
+        const paint_value* cell_ptr(int x, int y) const {
+            return tile_ptr(x, y);
+        }
+
+        std::ptrdiff_t cell_stride() const {
+            return 1;
+        }
+
+        std::ptrdiff_t layer_stride() const {
+            return k_tile_area;
+        }
+
+        int contiguous_cells(int x) const {
+            return std::min(k_tile_size - x % k_tile_size, cols_ - x);
+        }
+
+        int cols() const;
+        int rows() const;
+        int layers() const;
+        tile_store_stats stats() const;
+
+        // the whole of the storage as laid out in the file. Reading it writes back every
+        // resident tile first; writing it also empties the slots, so the next access to
+        // each tile reads what was written.
+        std::span<const paint_value> entries() const;
+        std::span<paint_value> entries();
+    };
+
+}
@@ -1,4 +1,5 @@
 #include "util.hpp"
+#include "random.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "third-party/stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -6,9 +7,9 @@
 #include "third-party/PerlinNoise.hpp"
 #include <ranges>
 #include <filesystem>
+#include <fstream>
 #include <stdexcept>
 #include <format>
-#include <random>
 #include <print>
 #include <stdexcept>
 
@@ -20,9 +21,6 @@ namespace rv = std::ranges::views;
 
 namespace {
 
-    std::random_device rd;
-    std::mt19937 g_generator( rd() );
-
     double normalize(double value, double min, double max) {
         return (value - min) / (max - min);
     }
@@ -54,7 +52,7 @@ void flo::display_title() {
 }
 
 void flo::set_rand_seed(uint32_t seed) {
-    g_generator = std::mt19937{ seed };
+    seed_rng_streams(seed);
 }
 
 uint32_t flo::rgb_to_pixel(const rgb_color& rgb) {
@@ -69,27 +67,37 @@ flo::rgb_color flo::pixel_to_rgb(uint32_t pixel) {
     return rgb;
 }
 
-void flo::img_to_file(const std::string& fname, const image& img) {
+void flo::img_to_file(const std::string& fname, const image& img, int png_level,
+        int num_threads) {
     auto extension = fs::path(fname).extension().string();
-    if (extension != ".png" && extension != ".bmp") {
-        throw std::runtime_error("unknown output image format");
+    if (extension == ".bmp") {
+        if (!stbi_write_bmp(fname.c_str(), img.cols(), img.rows(), 4, img.data())) {
+            throw std::runtime_error(std::format("unknown error while writing {}", extension));
+        }
+        return;
     }
-    int result = 0;
+
+    std::vector<uint8_t> encoded;
+    std::span<const uint8_t> bytes;
     if (extension == ".png") {
-        result = stbi_write_png(
-            fname.c_str(), img.cols(), img.rows(), 4, img.data(), 4 * img.cols()
-        );
-    }
-    else {
-        result = stbi_write_bmp(
-            fname.c_str(), img.cols(), img.rows(), 4, img.data()
-        );
+        encoded = encode_png(img, png_level, num_threads);
+        bytes = encoded;
+    } else if (extension == ".qoi") {
+        encoded = encode_qoi(img);
+        bytes = encoded;
+    } else if (extension == ".rgba") {
+        bytes = {
+            static_cast<const uint8_t*>(img.data()),
+            4 * static_cast<size_t>(img.cols()) * img.rows()
+        };
+    } else {
+        throw std::runtime_error("unknown output image format");
     }
 
-    if (!result) {
-        throw std::runtime_error(
-            std::format("unknown error while writing {}", extension)
-        );
+    std::ofstream file(fname, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    if (!file) {
+        throw std::runtime_error(std::format("unable to write {}", fname));
     }
 }
 
@@ -97,6 +105,9 @@ flo::image flo::img_from_file(const std::string& fname)
 {
     int wd, hgt, n;
     unsigned char *data = stbi_load(fname.c_str(), &wd, &hgt, &n, 4);
+    if (!data) {
+        throw std::runtime_error("unable to read " + fname);
+    }
     flo::image img(wd,hgt);
     for (int y = 0; y < hgt; ++y) {
         for (int x = 0; x < wd; ++x) {
@@ -105,6 +116,7 @@ flo::image flo::img_from_file(const std::string& fname)
             img[x, y] = pix;
         }
     }
+    stbi_image_free(data);
     return img;
 }
 
@@ -151,7 +163,7 @@ flo::scalar_field flo::white_noise(int wd, int hgt) {
 flo::scalar_field flo::perlin_noise(const flo::dimensions& sz, int octaves, double freq) {
     auto noise = scalar_field(sz.wd, sz.hgt, 0.0);
 
-    siv::PerlinNoise perlin{ g_generator() };
+    siv::PerlinNoise perlin{ static_cast<siv::PerlinNoise::seed_type>(main_rng()()) };
     auto dim = std::max(sz.wd, sz.hgt);
     double freq_per_pix = freq / dim;
 
@@ -174,21 +186,18 @@ flo::rgb_color flo::random_rgb_color() {
 }
 
 int flo::rand_number(int min, int max) {
-    std::uniform_int_distribution<int> distribution(min, max);
-    return distribution(g_generator);
+    return main_rng().uniform_int(min, max);
 }
 
 double flo::normal_rand(double mean, double stddev) {
     if (stddev == 0.0) {
         return mean;
     }
-    std::normal_distribution<double> distribution(mean, stddev);
-    return distribution(g_generator);
+    return main_rng().normal(mean, stddev);
 }
 
 double flo::uniform_rand(double low, double high) {
-    static std::uniform_real_distribution<double> distribution(low, high);
-    return distribution(g_generator);
+    return main_rng().uniform(low, high);
 }
 
 bool flo::in_bounds(const point& p, const dimensions& dim) {
@@ -201,7 +210,7 @@ bool flo::in_bounds(const coords& p, const dimensions& dim) {
     return p.x >= 0 && p.x < dim.wd && p.y >= 0 && p.y < dim.hgt;
 }
 
-flo::dimensions flo::convex_hull_bounds(std::span<point> pts) {
+flo::dimensions flo::convex_hull_bounds(std::span<const point> pts) {
 
     if (pts.empty()) return dimensions{ 0, 0 };
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.hpp"
+#include "image_encoders.hpp"
 #include <string>
 #include <span>
 
@@ -11,7 +12,12 @@ namespace flo {
     void set_rand_seed(uint32_t seed);
     uint32_t rgb_to_pixel(const rgb_color& rgb);
     rgb_color pixel_to_rgb(uint32_t pix);
-    void img_to_file(const std::string& fname, const image& img);
+
+    // the format follows the extension: .png, .qoi, .bmp, or .rgba for the raw pixels
+    // with no header. png_level and num_threads apply to PNG; see encode_png().
+    void img_to_file(const std::string& fname, const image& img,
+        int png_level = k_default_png_level, int num_threads = 1);
+
     image img_from_file(const std::string& fname);
     scalar_field normalize(const scalar_field& s);
     image to_gray_scale_image(const scalar_field& sf, bool invert = false);
@@ -24,7 +30,7 @@ namespace flo {
     double uniform_rand(double low = 0.0, double high = 1.0);
     bool in_bounds(const point& p, const dimensions& dim);
     bool in_bounds(const coords& p, const dimensions& dim);
-    dimensions convex_hull_bounds(std::span<point> pts);
+    dimensions convex_hull_bounds(std::span<const point> pts);
     coords to_coords(const point& pt);
     point to_point(const coords& cds);
     rgb_color hex_str_to_rgb(const std::string& hex);
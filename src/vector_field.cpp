@@ -1,5 +1,11 @@
 #include "vector_field.hpp"
 #include "util.hpp"
+#include "convolution.hpp"
+#include "mass_tree.hpp"
+#include "random.hpp"
+#include "thread_pool.hpp"
+#include "third-party/PerlinNoise.hpp"
+#include <memory>
 #include <numbers>
 
 namespace r = std::ranges;
@@ -9,49 +15,9 @@ namespace rv = std::ranges::views;
 
 namespace {
 
-    flo::scalar_field signed_pow(const flo::scalar_field& field, double exp) {
-        auto power = [exp](double v) {
-            return flo::sgn(v) * std::pow(std::abs(v), exp);
-            };
-        return field.transform_to(power);
-    }
-
-    flo::matrix<double> gaussian_neighborhood(int sz) {
-        if (sz % 2 == 0) {
-            throw std::invalid_argument("Size must be odd");
-        }
-
-        flo::matrix<double> kernel(sz, sz);
-        double sigma = sz / 3.0; // Standard deviation
-        int half_sz = sz / 2;
-        double sum = 0.0;
+    // below this many masses Barnes-Hut saves too little to be worth its error.
+    constexpr size_t k_max_exact_gravity_masses = 64;
 
-        // Compute Gaussian function values
-        for (int y = 0; y < sz; ++y) {
-            for (int x = 0; x < sz; ++x) {
-                if (x == half_sz && y == half_sz) {
-                    kernel[x, y] = 0.0; // Ensure center is zero
-                }
-                else {
-                    double dx = x - half_sz;
-                    double dy = y - half_sz;
-                    kernel[x, y] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
-                    sum += kernel[x, y];
-                }
-            }
-        }
-
-        // Normalize the kernel so the sum is 1.0
-        if (sum != 0.0) {
-            for (int y = 0; y < sz; ++y) {
-                for (int x = 0; x < sz; ++x) {
-                    kernel[x, y] /= sum;
-                }
-            }
-        }
-
-        return kernel;
-    }
     /*
     flo::point tangent_of_loxodromic_spiral(
             bool outward,
@@ -116,25 +82,31 @@ namespace {
         point center1 = { width / 2.0 - dist / 2.0, height / 2.0 }; // Left center
         point center2 = { width / 2.0 + dist / 2.0, height / 2.0 }; // Right center
 
-        // Compute polar coordinates relative to each center
+        // Compute polar coordinates relative to each center. The sine and cosine of each
+        // angle are taken directly from the offsets rather than through atan2, sin and cos;
+        // at a center the angle is 0, as atan2(0, 0) would give.
         double dx1 = x - center1.x, dy1 = y - center1.y;
-        double r1 = std::sqrt(dx1 * dx1 + dy1 * dy1) + 1e-6; // Avoid div by zero
-        double theta1 = std::atan2(dy1, dx1);
+        double dist1 = std::sqrt(dx1 * dx1 + dy1 * dy1);
+        double r1 = dist1 + 1e-6; // Avoid div by zero
+        double cos1 = dist1 > 0.0 ? dx1 / dist1 : 1.0;
+        double sin1 = dist1 > 0.0 ? dy1 / dist1 : 0.0;
 
         double dx2 = x - center2.x, dy2 = y - center2.y;
-        double r2 = std::sqrt(dx2 * dx2 + dy2 * dy2) + 1e-6;
-        double theta2 = std::atan2(dy2, dx2);
+        double dist2 = std::sqrt(dx2 * dx2 + dy2 * dy2);
+        double r2 = dist2 + 1e-6;
+        double cos2 = dist2 > 0.0 ? dx2 / dist2 : 1.0;
+        double sin2 = dist2 > 0.0 ? dy2 / dist2 : 0.0;
 
         // Determine spiral directions
         double direction1 = outward ? 1.0 : -1.0;  // Left spiral follows 'outward'
         double direction2 = -direction1;          // Right spiral is the opposite
 
         // Compute tangent vectors for logarithmic spirals
-        double tangent_x1 = direction1 * (-std::sin(theta1) + theta_rate * std::cos(theta1));
-        double tangent_y1 = direction1 * (std::cos(theta1) + theta_rate * std::sin(theta1));
+        double tangent_x1 = direction1 * (-sin1 + theta_rate * cos1);
+        double tangent_y1 = direction1 * (cos1 + theta_rate * sin1);
 
-        double tangent_x2 = direction2 * (-std::sin(theta2) + theta_rate * std::cos(theta2));
-        double tangent_y2 = direction2 * (std::cos(theta2) + theta_rate * std::sin(theta2));
+        double tangent_x2 = direction2 * (-sin2 + theta_rate * cos2);
+        double tangent_y2 = direction2 * (cos2 + theta_rate * sin2);
 
         // Weight the influence of each spiral inversely by distance
         double weight1 = 1.0 / (r1 + 1e-6);
@@ -189,21 +161,24 @@ namespace {
     }
 
 
-    flo::vector_field normalized_vector_field(
-        const flo::scalar_field& x_field, const flo::scalar_field& y_field) {
-
-        auto x_comp = x_field;
-        auto y_comp = y_field;
-
-        for (auto [x, y] : flo::locations(x_field.bounds())) {
-            auto horz = x_field[x, y];
-            auto vert = y_field[x, y];
-            auto hypot = std::hypot(horz, vert);
-            x_comp[x, y] /= hypot;
-            y_comp[x, y] /= hypot;
+    void normalize_vectors(int n, double* xs, double* ys) {
+        for (int i = 0; i < n; ++i) {
+            auto hypot = std::hypot(xs[i], ys[i]);
+            xs[i] /= hypot;
+            ys[i] /= hypot;
         }
+    }
 
-        return { x_comp, y_comp };
+    // field_rows from a function giving the vector at cell (x, y).
+    template<typename F>
+    flo::field_rows per_cell_rows(F vector_at) {
+        return [vector_at](int y, int x_begin, int n, double* xs, double* ys) {
+            for (int i = 0; i < n; ++i) {
+                flo::point vec = vector_at(x_begin + i, y);
+                xs[i] = vec.x;
+                ys[i] = vec.y;
+            }
+        };
     }
 
     flo::point rotate_90(const flo::point& p, bool clockwise) {
@@ -238,28 +213,118 @@ namespace {
         }
         return vec;
     }
-}
 
-flo::vector_field flo::perlin_vector_field(
-        const flo::dimensions& sz, int octaves, double freq,
-        double exponent, bool normalized) {
+    flo::point elliptic_vector(int x, int y, double o_x, double o_y,
+            flo::circle_field_type type) {
+        // Define the axes of the ellipse
+        double a = o_x;  // Semi-major axis (along the x-direction)
+        double b = o_y;  // Semi-minor axis (along the y-direction)
 
-    auto x_noise = perlin_noise(sz, octaves, freq);
-    auto y_noise = perlin_noise(sz, octaves, freq);
+        auto outward_x = x - o_x;
+        auto outward_y = y - o_y;
 
-    auto x_comp = 2.0 * x_noise - 1.0;
-    auto y_comp = 2.0 * y_noise - 1.0;
+        // Apply the ellipse scaling factors (a for x-axis, b for y-axis)
+        auto scale_x = outward_x / a;
+        auto scale_y = outward_y / b;
+
+        auto hypot = std::hypot(scale_x, scale_y);  // Hypotenuse in the scaled ellipse
+        auto outward = (1.0 / hypot) * flo::point{ scale_x, scale_y };
+        flo::point vec;
+
+        switch (type) {
+        case flo::circle_field_type::outward:
+            vec = outward;
+            break;
+        case flo::circle_field_type::inward:
+            vec = -1.0 * outward;
+            break;
+        case flo::circle_field_type::clockwise:
+            vec = rotate_90(outward, true);
+            break;
+        case flo::circle_field_type::counterclockwise:
+            vec = rotate_90(outward, false);
+            break;
+        }
+        return vec;
+    }
+
+    flo::point zigzag_vector(const flo::dimensions& dim, int x, int y, double radius) {
+        int row = y / static_cast<int>(radius);
+        bool rightward = (row % 2 == 0);
+        double left_boundary = radius;
+        double right_boundary = dim.wd - radius;
+
+        if (x > left_boundary && x < right_boundary) {
+            return { rightward ? 1.0 : -1.0, 0.0 };
+        }
+
+        flo::circle_field_type orientation;
+        int center_row;
+        double cen_x;
+        if (x >= right_boundary) {
+            center_row = row % 2 == 0 ? row + 1 : row;
+            cen_x = right_boundary,
+            orientation = flo::circle_field_type::clockwise;
+        } else {
+            center_row = row % 2 == 0 ? row : row + 1;
+            cen_x = left_boundary;
+            orientation = flo::circle_field_type::counterclockwise;
+        }
+        return circular_vector(x, y, { cen_x, center_row * radius }, orientation);
+    }
 
-    if (exponent != 1.0) {
-        x_noise = signed_pow(x_noise, exponent);
-        y_noise = signed_pow(y_noise, exponent);
+    flo::point normalized_gravity(double field_x, double field_y) {
+        double magnitude = std::hypot(field_x, field_y);
+        if (magnitude > 1e-6) {
+            field_x /= magnitude;
+            field_y /= magnitude;
+        }
+        else {
+            field_x = 0.0;
+            field_y = 0.0;
+        }
+        return { field_x, field_y };
     }
 
-    if (normalized) {
-        return normalized_vector_field(x_comp, y_comp);
+    flo::point gravity_vector(int x, int y, const std::vector<flo::point_mass>& masses,
+            double grav_const, bool normalize) {
+        double field_x = 0.0, field_y = 0.0;
+
+        for (const auto& mass : masses) {
+            double dx = mass.loc.x - x;
+            double dy = mass.loc.y - y;
+            double dist_sq = dx * dx + dy * dy;
+            double dist = std::sqrt(dist_sq);
+
+            if (dist_sq > 1e-6) { // Avoid singularity
+                double force = grav_const * mass.mass / dist_sq;
+                field_x += force * (dx / dist);
+                field_y += force * (dy / dist);
+            }
+        }
+
+        return normalize ? normalized_gravity(field_x, field_y) : flo::point{ field_x, field_y };
     }
+}
 
-    return { x_comp, y_comp };
+flo::vector_field flo::evaluate(const dimensions& dim, const field_rows& rows, int num_threads) {
+    vector_field field{ scalar_field(dim), scalar_field(dim) };
+    thread_pool pool(num_threads);
+    pool.parallel_for(dim.hgt,
+        [&](int y) {
+            rows(y, 0, dim.wd, &field.x[0, y], &field.y[0, y]);
+        }
+    );
+    return field;
+}
+
+flo::vector_field flo::evaluate(const deferred_field& field) {
+    return evaluate(field.dim, field.rows, field.num_threads);
+}
+
+flo::vector_field flo::perlin_vector_field(
+        const flo::dimensions& sz, int octaves, double freq, bool normalized) {
+    return evaluate(sz, perlin_field_rows(sz, octaves, freq, normalized));
 }
 
 flo::vector_field flo::vector_field_from_scalar_fields(
@@ -274,7 +339,11 @@ flo::vector_field flo::vector_field_from_scalar_fields(
 }
 
 flo::vector_field flo::normalize(const vector_field& vf) {
-    return normalized_vector_field(vf.x, vf.y);
+    auto normalized = vf;
+    for (int y = 0; y < vf.x.rows(); ++y) {
+        normalize_vectors(vf.x.cols(), &normalized.x[0, y], &normalized.y[0, y]);
+    }
+    return normalized;
 }
 
 flo::point flo::vector_from_field(const vector_field& vf, const point& pt) {
@@ -320,227 +389,256 @@ flo::point flo::vector_from_field(const vector_field& vf, const point& pt) {
 }
 
 flo::vector_field flo::circular_vector_field(const dimensions& dim, circle_field_type type) {
-    scalar_field x_comp(dim);
-    scalar_field y_comp(dim);
-    auto center = point{
-        static_cast<double>(dim.wd) / 2.0,
-        static_cast<double>(dim.hgt) / 2.0
-    };
-
-    for (auto [x, y] : locations(dim)) {
-        auto vec = circular_vector(x, y, center, type);
-        x_comp[x, y] = vec.x;
-        y_comp[x, y] = vec.y;
-    }
-
-    return { x_comp, y_comp  };
+    return evaluate(dim, circular_field_rows(dim, type));
 }
 
-flo::vector_field flo::elliptic_vector_field(const dimensions& dim, circle_field_type type)
-{
-    scalar_field x_comp(dim);
-    scalar_field y_comp(dim);
-    auto o_x = static_cast<double>(dim.wd) / 2.0;
-    auto o_y = static_cast<double>(dim.hgt) / 2.0;
-
-    // Define the axes of the ellipse
-    double a = o_x;  // Semi-major axis (along the x-direction)
-    double b = o_y;  // Semi-minor axis (along the y-direction)
-
-    for (auto [x, y] : locations(dim)) {
-        auto outward_x = x - o_x;
-        auto outward_y = y - o_y;
-
-        // Apply the ellipse scaling factors (a for x-axis, b for y-axis)
-        auto scale_x = outward_x / a;
-        auto scale_y = outward_y / b;
-
-        auto hypot = std::hypot(scale_x, scale_y);  // Hypotenuse in the scaled ellipse
-        auto outward = (1.0 / hypot) * flo::point{ scale_x, scale_y };
-        point vec;
-
-        switch (type) {
-        case circle_field_type::outward:
-            vec = outward;
-            break;
-        case circle_field_type::inward:
-            vec = -1.0 * outward;
-            break;
-        case circle_field_type::clockwise:
-            vec = rotate_90(outward, true);
-            break;
-        case circle_field_type::counterclockwise:
-            vec = rotate_90(outward, false);
-            break;
-        }
-
-        x_comp[x, y] = vec.x;
-        y_comp[x, y] = vec.y;
-    }
-
-    return {
-        x_comp,
-        y_comp
-    };
+flo::vector_field flo::elliptic_vector_field(const dimensions& dim, circle_field_type type) {
+    return evaluate(dim, elliptic_field_rows(dim, type));
 }
 
 flo::vector_field flo::loxodromic_spiral_vector_field(
         const dimensions& dim, bool outward, double centers_dist, double theta_rate) {
-    auto xx = flo::scalar_field(dim);
-    auto yy = flo::scalar_field(dim);
-    for (auto [x, y] : flo::locations(dim)) {
-        auto vec2 = tangent_of_loxodromic_spiral(
-            outward, x, y, centers_dist, dim.wd, dim.hgt, theta_rate
-        );
-        xx[x, y] = vec2.x;
-        yy[x, y] = vec2.y;
-    }
-    return flo::vector_field(xx, yy);
+    return evaluate(dim, loxodromic_spiral_field_rows(dim, outward, centers_dist, theta_rate));
 }
 
 flo::vector_field flo::logarithmic_spiral_vector_field(
         const dimensions& dim, double b, bool inward, bool clockwise) {
-    auto xx = flo::scalar_field(dim);
-    auto yy = flo::scalar_field(dim);
-    for (auto [x, y] : flo::locations(dim)) {
-        auto vec2 = logarithmic_spiral_vector(dim, x, y, b, inward, clockwise);
-        xx[x, y] = vec2.x;
-        yy[x, y] = vec2.y;
-    }
-    return flo::vector_field(xx, yy);
+    return evaluate(dim, logarithmic_spiral_field_rows(dim, b, inward, clockwise));
 }
 
 flo::vector_field flo::zigzag_vector_field(const flo::dimensions& dim, double radius) {
-
-    flo::scalar_field x_comp(dim);
-    flo::scalar_field y_comp(dim);
-
-    for (auto [x, y] : flo::locations(dim)) {
-        int row = y / static_cast<int>(radius);
-        bool rightward = (row % 2 == 0);
-        double left_boundary = radius;
-        double right_boundary = dim.wd - radius;
-
-        if (x > left_boundary && x < right_boundary) {
-            x_comp[x, y] = rightward ? 1.0 : -1.0;
-            y_comp[x, y] = 0.0;
-            continue;
-        }
-
-        circle_field_type orientation;
-        int center_row;
-        double cen_x;
-        if (x >= right_boundary) {
-            center_row = row % 2 == 0 ? row + 1 : row;
-            cen_x = right_boundary,
-            orientation = flo::circle_field_type::clockwise;
-        } else {
-            center_row = row % 2 == 0 ? row : row + 1;
-            cen_x = left_boundary;
-            orientation = flo::circle_field_type::counterclockwise;
-        }
-        auto vec = circular_vector(x, y, { cen_x, center_row * radius }, orientation);
-        x_comp[x, y] = vec.x;
-        y_comp[x, y] = vec.y;
-    }
-
-    return { x_comp, y_comp };
+    return evaluate(dim, zigzag_field_rows(dim, radius));
 }
 
-flo::vector_field flo::gradient(const scalar_field& img, int kernel_sz, bool hamiltonian) {
+flo::vector_field flo::gradient(const scalar_field& img, int kernel_sz, bool hamiltonian,
+        int num_threads) {
     if (kernel_sz % 2 == 0) {
         throw std::invalid_argument("Kernel size must be odd");
     }
 
+    // the stencil weighs the neighbor at (kx, ky) by g(kx) * g(ky) * kx for the x component
+    // and by g(kx) * g(ky) * ky for the y component, g being a Gaussian, so each component
+    // is a derivative pass along one axis followed by a smoothing pass along the other.
+    // The stencil's overall scale is left out, as the gradient is normalized.
     int half_sz = kernel_sz / 2;
-    auto kernel = gaussian_neighborhood(kernel_sz);
-    vector_field grad{ scalar_field(img.cols(), img.rows(), 0.0), scalar_field(img.cols(), img.rows(), 0.0) };
-
-    for (int y = 0; y < img.rows(); ++y) {
-        for (int x = 0; x < img.cols(); ++x) {
-            double grad_x = 0.0, grad_y = 0.0;
-            double center_val = img[x, y];
-
-            for (int ky = -half_sz; ky <= half_sz; ++ky) {
-                for (int kx = -half_sz; kx <= half_sz; ++kx) {
-                    int nx = x + kx;
-                    int ny = y + ky;
-                    double neighbor_val = 0.0;
-
-                    if (nx >= 0 && nx < img.cols() && ny >= 0 && ny < img.rows()) {
-                        neighbor_val = img[nx, ny];
-                    }
-
-                    double weight = kernel[kx + half_sz, ky + half_sz];
-                    grad_x += weight * (neighbor_val - center_val) * kx;
-                    grad_y += weight * (neighbor_val - center_val) * ky;
-                }
-            }
+    double sigma = kernel_sz / 3.0; // Standard deviation
+    std::vector<double> smooth(kernel_sz);
+    std::vector<double> derivative(kernel_sz);
+    for (int k = -half_sz; k <= half_sz; ++k) {
+        double g = std::exp(-(k * k) / (2 * sigma * sigma));
+        smooth[half_sz + k] = g;
+        derivative[half_sz + k] = g * k;
+    }
 
-            // Normalize gradient to range [-1, 1]
-            double magnitude = std::hypot(grad_x, grad_y);
-            if (magnitude > 0) {
-                grad_x /= magnitude;
-                grad_y /= magnitude;
-            }
-            else {
-                grad_x = 0.0;
-                grad_y = 0.0;
-            }
+    thread_pool pool(num_threads);
+    auto grad_x = filter_cols(filter_rows(img, derivative, pool), smooth, pool);
+    auto grad_y = filter_rows(filter_cols(img, derivative, pool), smooth, pool);
+
+    // components this small next to the largest the image could give are rounding error,
+    // as in flat regions, and count as no gradient.
+    auto magnitudes = rv::transform([](double v) { return std::abs(v); });
+    double max_value = r::fold_left(img.entries() | magnitudes, 0.0,
+        [](double lhs, double rhs) { return std::max(lhs, rhs); });
+    double max_grad = max_value *
+        r::fold_left(smooth, 0.0, std::plus<>()) *
+        r::fold_left(derivative | magnitudes, 0.0, std::plus<>());
+    double threshold = 1e-12 * max_grad;
+
+    vector_field grad{ scalar_field(img.bounds()), scalar_field(img.bounds()) };
+    pool.parallel_for(img.rows(),
+        [&](int y) {
+            for (int x = 0; x < img.cols(); ++x) {
+                double gx = grad_x[x, y];
+                double gy = grad_y[x, y];
+
+                // Normalize gradient to range [-1, 1]
+                double magnitude = std::hypot(gx, gy);
+                if (magnitude > threshold) {
+                    gx /= magnitude;
+                    gy /= magnitude;
+                }
+                else {
+                    gx = 0.0;
+                    gy = 0.0;
+                }
 
-            if (hamiltonian) {
-                grad.x[x, y] = -grad_y;
-                grad.y[x, y] = grad_x;
-            }
-            else {
-                grad.x[x, y] = grad_x;
-                grad.y[x, y] = grad_y;
+                if (hamiltonian) {
+                    grad.x[x, y] = -gy;
+                    grad.y[x, y] = gx;
+                }
+                else {
+                    grad.x[x, y] = gx;
+                    grad.y[x, y] = gy;
+                }
             }
         }
-    }
+    );
 
     return grad;
 }
 
-flo::vector_field flo::gravity(const dimensions& dim, const std::vector<point_mass>& masses, double grav_const, bool normalize) {
-    vector_field field{ 
-        scalar_field(dim.wd, dim.hgt, 0.0), 
-        scalar_field(dim.wd, dim.hgt, 0.0) 
+flo::vector_field flo::gravity(const dimensions& dim, const std::vector<point_mass>& masses,
+        double grav_const, bool normalize, double theta) {
+    return evaluate(dim, gravity_field_rows(masses, grav_const, normalize, theta));
+}
+
+flo::field_rows flo::perlin_field_rows(
+        const dimensions& sz, int octaves, double freq, bool normalized) {
+    // one seed for each component, drawn x first.
+    siv::PerlinNoise x_perlin{ static_cast<siv::PerlinNoise::seed_type>(main_rng()()) };
+    siv::PerlinNoise y_perlin{ static_cast<siv::PerlinNoise::seed_type>(main_rng()()) };
+    auto dim = std::max(sz.wd, sz.hgt);
+    double freq_per_pix = freq / dim;
+
+    return [=](int y, int x_begin, int n, double* xs, double* ys) {
+        for (int i = 0; i < n; ++i) {
+            int x = x_begin + i;
+            xs[i] = 2.0 * x_perlin.octave2D_01(x * freq_per_pix, y * freq_per_pix, octaves) - 1.0;
+            ys[i] = 2.0 * y_perlin.octave2D_01(x * freq_per_pix, y * freq_per_pix, octaves) - 1.0;
+        }
+        if (normalized) {
+            normalize_vectors(n, xs, ys);
+        }
     };
+}
 
-    for (auto [x,y] : locations(dim)) {
-        double field_x = 0.0, field_y = 0.0;
+flo::field_rows flo::circular_field_rows(const dimensions& dim, circle_field_type type) {
+    auto center = point{
+        static_cast<double>(dim.wd) / 2.0,
+        static_cast<double>(dim.hgt) / 2.0
+    };
+    return per_cell_rows(
+        [=](int x, int y) {
+            return circular_vector(x, y, center, type);
+        }
+    );
+}
 
-        for (const auto& mass : masses) {
-            double dx = mass.loc.x - x;
-            double dy = mass.loc.y - y;
-            double dist_sq = dx * dx + dy * dy;
-            double dist = std::sqrt(dist_sq);
+flo::field_rows flo::elliptic_field_rows(const dimensions& dim, circle_field_type type) {
+    auto o_x = static_cast<double>(dim.wd) / 2.0;
+    auto o_y = static_cast<double>(dim.hgt) / 2.0;
+    return per_cell_rows(
+        [=](int x, int y) {
+            return elliptic_vector(x, y, o_x, o_y, type);
+        }
+    );
+}
 
-            if (dist_sq > 1e-6) { // Avoid singularity
-                double force = grav_const * mass.mass / dist_sq;
-                field_x += force * (dx / dist);
-                field_y += force * (dy / dist);
-            }
+flo::field_rows flo::loxodromic_spiral_field_rows(
+        const dimensions& dim, bool outward, double centers_dist, double theta_rate) {
+    return per_cell_rows(
+        [=](int x, int y) {
+            return tangent_of_loxodromic_spiral(
+                outward, x, y, centers_dist, dim.wd, dim.hgt, theta_rate
+            );
+        }
+    );
+}
+
+flo::field_rows flo::logarithmic_spiral_field_rows(
+        const dimensions& dim, double b, bool inward, bool clockwise) {
+    return per_cell_rows(
+        [=](int x, int y) {
+            return logarithmic_spiral_vector(dim, x, y, b, inward, clockwise);
         }
+    );
+}
 
-        if (normalize) {
-            double magnitude = std::hypot(field_x, field_y);
-            if (magnitude > 1e-6) {
-                field_x /= magnitude;
-                field_y /= magnitude;
-            }
-            else {
-                field_x = 0.0;
-                field_y = 0.0;
+flo::field_rows flo::zigzag_field_rows(const dimensions& dim, double radius) {
+    return per_cell_rows(
+        [=](int x, int y) {
+            return zigzag_vector(dim, x, y, radius);
+        }
+    );
+}
+
+flo::field_rows flo::gravity_field_rows(const std::vector<point_mass>& masses,
+        double grav_const, bool normalize, double theta) {
+    if (theta > 0.0 && masses.size() > k_max_exact_gravity_masses) {
+        auto tree = std::make_shared<mass_tree>(masses, theta);
+        return per_cell_rows(
+            [=](int x, int y) {
+                auto field = tree->field_at(x, y);
+                field = { grav_const * field.x, grav_const * field.y };
+                return normalize ? normalized_gravity(field.x, field.y) : field;
             }
+        );
+    }
+    return per_cell_rows(
+        [=](int x, int y) {
+            return gravity_vector(x, y, masses, grav_const, normalize);
         }
+    );
+}
 
-        field.x[x, y] = field_x;
-        field.y[x, y] = field_y;
+flo::field_rows flo::stored_field_rows(const dimensions& dim, vector_field field) {
+    auto stored = std::make_shared<const vector_field>(std::move(field));
+    if (stored->x.cols() == dim.wd && stored->x.rows() == dim.hgt) {
+        return [stored](int y, int x_begin, int n, double* xs, double* ys) {
+            r::copy_n(&stored->x[x_begin, y], n, xs);
+            r::copy_n(&stored->y[x_begin, y], n, ys);
+        };
     }
 
-    return field;
+    // cell centers are aligned, so the field is neither shifted nor stretched at its edges.
+    double scale_x = static_cast<double>(stored->x.cols()) / dim.wd;
+    double scale_y = static_cast<double>(stored->x.rows()) / dim.hgt;
+    return per_cell_rows(
+        [=](int x, int y) {
+            return vector_from_field(*stored,
+                { (x + 0.5) * scale_x - 0.5, (y + 0.5) * scale_y - 0.5 }
+            );
+        }
+    );
+}
+
+flo::field_rows flo::normalize_rows(field_rows arg) {
+    return [arg = std::move(arg)](int y, int x_begin, int n, double* xs, double* ys) {
+        arg(y, x_begin, n, xs, ys);
+        normalize_vectors(n, xs, ys);
+    };
+}
+
+flo::field_rows flo::scale_rows(const point& v, field_rows arg) {
+    return [v, arg = std::move(arg)](int y, int x_begin, int n, double* xs, double* ys) {
+        arg(y, x_begin, n, xs, ys);
+        for (int i = 0; i < n; ++i) {
+            xs[i] = v.x * xs[i];
+            ys[i] = v.y * ys[i];
+        }
+    };
+}
+
+flo::field_rows flo::scale_rows(double k, field_rows arg) {
+    return scale_rows(point{ k, k }, std::move(arg));
+}
+
+flo::field_rows flo::offset_rows(const point& v, field_rows arg) {
+    return [v, arg = std::move(arg)](int y, int x_begin, int n, double* xs, double* ys) {
+        arg(y, x_begin, n, xs, ys);
+        for (int i = 0; i < n; ++i) {
+            xs[i] = xs[i] + v.x;
+            ys[i] = ys[i] + v.y;
+        }
+    };
+}
+
+flo::field_rows flo::offset_rows(double k, field_rows arg) {
+    return offset_rows(point{ k, k }, std::move(arg));
+}
+
+flo::field_rows flo::sum_rows(field_rows lhs, field_rows rhs) {
+    return [lhs = std::move(lhs), rhs = std::move(rhs)](
+            int y, int x_begin, int n, double* xs, double* ys) {
+        std::vector<double> rhs_xs(n);
+        std::vector<double> rhs_ys(n);
+        lhs(y, x_begin, n, xs, ys);
+        rhs(y, x_begin, n, rhs_xs.data(), rhs_ys.data());
+        for (int i = 0; i < n; ++i) {
+            xs[i] = xs[i] + rhs_xs[i];
+            ys[i] = ys[i] + rhs_ys[i];
+        }
+    };
 }
 
 flo::vector_field flo::operator*(const point& v, const vector_field& field) {
@@ -1,6 +1,7 @@
 #pragma once 
 
 #include "types.hpp"
+#include <functional>
 #include <vector>
 
 /*------------------------------------------------------------------------------------------------*/
@@ -12,8 +13,30 @@ namespace flo {
         scalar_field y;
     };
 
+    // a vector field evaluated a row segment at a time: writes the vectors at cells
+    // [x_begin, x_begin + n) of row y to xs and ys. Field definitions are composed from
+    // these, so a whole definition is evaluated in one pass into a single field without
+    // materializing a field for each of its terms. Rows may be evaluated concurrently.
+    using field_rows = std::function<void(int y, int x_begin, int n, double* xs, double* ys)>;
+
+    // evaluates rows in parallel; num_threads of 0 means one thread per hardware core.
+    // The result does not depend on the number of threads.
+    vector_field evaluate(const dimensions& dim, const field_rows& rows, int num_threads = 1);
+
+    // a field definition together with how to evaluate it, for fields that are evaluated
+    // some time after they are defined. Any random draws a definition needs are made when
+    // it is built, so the field comes out the same whenever and on whichever thread it is
+    // evaluated, and a definition may be evaluated more than once.
+    struct deferred_field {
+        dimensions dim;
+        field_rows rows;
+        int num_threads;
+    };
+
+    vector_field evaluate(const deferred_field& field);
+
     vector_field perlin_vector_field(const flo::dimensions& sz, int octaves, double freq,
-        double exponent = 1.0, bool normalized = true);
+        bool normalized = true);
     vector_field vector_field_from_scalar_fields(const scalar_field& x, const scalar_field& y);
     vector_field normalize(const vector_field& vf);
     point vector_from_field(const vector_field& vf, const point& pt);
@@ -32,14 +55,48 @@ namespace flo {
     vector_field logarithmic_spiral_vector_field(
         const dimensions& dim, double b, bool inward, bool clockwise);
     vector_field zigzag_vector_field(const dimensions& dim, double radius);
-    vector_field gradient(const scalar_field& img, int kernel_sz, bool hamiltonian);
+
+    // the normalized gradient of img, smoothed by a Gaussian kernel_sz wide, or with
+    // hamiltonian the gradient turned 90 degrees so that the field follows img's level
+    // curves. Large kernels are applied through the FFT; see filter_rows. num_threads of
+    // 0 means one thread per hardware core.
+    vector_field gradient(const scalar_field& img, int kernel_sz, bool hamiltonian,
+        int num_threads = 1);
 
     struct point_mass {
         double mass;
         flo::point loc;
     };
+
+    // the field of masses attracting along 1/distance^2. A theta greater than 0 evaluates
+    // it approximately, in O(log M) per cell rather than O(M), once there are enough masses
+    // for that to pay; see mass_tree. Larger theta is faster and less accurate, and 0.5 is
+    // a typical choice.
     vector_field gravity(const dimensions& dim, const std::vector<point_mass>& masses,
-        double grav_const = 1.0, bool normalize = true);
+        double grav_const = 1.0, bool normalize = true, double theta = 0.0);
+
+    // the noise for perlin_field_rows is seeded when it is called, so the random draws
+    // happen in the order the terms of a definition are built.
+    field_rows perlin_field_rows(const dimensions& sz, int octaves, double freq, bool normalized);
+    field_rows circular_field_rows(const dimensions& dim, circle_field_type type);
+    field_rows elliptic_field_rows(const dimensions& dim, circle_field_type type);
+    field_rows loxodromic_spiral_field_rows(const dimensions& dim,
+        bool outward, double centers_dist, double theta_rate);
+    field_rows logarithmic_spiral_field_rows(
+        const dimensions& dim, double b, bool inward, bool clockwise);
+    field_rows zigzag_field_rows(const dimensions& dim, double radius);
+    field_rows gravity_field_rows(const std::vector<point_mass>& masses,
+        double grav_const = 1.0, bool normalize = true, double theta = 0.0);
+
+    // the rows of a field already computed, resampled bilinearly if it is not of size dim.
+    field_rows stored_field_rows(const dimensions& dim, vector_field field);
+
+    field_rows normalize_rows(field_rows arg);
+    field_rows scale_rows(const point& v, field_rows arg);
+    field_rows scale_rows(double k, field_rows arg);
+    field_rows offset_rows(const point& v, field_rows arg);
+    field_rows offset_rows(double k, field_rows arg);
+    field_rows sum_rows(field_rows lhs, field_rows rhs);
 
     vector_field operator*(const point& v, const vector_field& field);
     vector_field operator*(double k, const vector_field& field);
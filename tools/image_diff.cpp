@@ -0,0 +1,129 @@
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <print>
+#include <string>
+
+/*------------------------------------------------------------------------------------------------*/
+
+// compares two images, typically the output of a float canvas build against the output of
+// a double canvas build run on the same input with the same rand_seed, and reports how far
+// apart their colors are.
+
+namespace {
+
+    struct lab {
+        double l;
+        double a;
+        double b;
+    };
+
+    double srgb_to_linear(uint8_t channel) {
+        double c = channel / 255.0;
+        return (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    double lab_f(double t) {
+        constexpr double delta = 6.0 / 29.0;
+        return (t > delta * delta * delta) ? std::cbrt(t) : t / (3.0 * delta * delta) + 4.0 / 29.0;
+    }
+
+    // CIE L*a*b* under a D65 white point.
+    lab rgb_to_lab(const flo::rgb_color& rgb) {
+        double r = srgb_to_linear(rgb.red);
+        double g = srgb_to_linear(rgb.green);
+        double b = srgb_to_linear(rgb.blue);
+
+        double x = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047;
+        double y = (0.2126 * r + 0.7152 * g + 0.0722 * b);
+        double z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883;
+
+        double fx = lab_f(x);
+        double fy = lab_f(y);
+        double fz = lab_f(z);
+        return { 116.0 * fy - 16.0, 500.0 * (fx - fy), 200.0 * (fy - fz) };
+    }
+
+    double delta_e(const flo::rgb_color& c1, const flo::rgb_color& c2) {
+        auto lab1 = rgb_to_lab(c1);
+        auto lab2 = rgb_to_lab(c2);
+        return std::hypot(lab1.l - lab2.l, lab1.a - lab2.a, lab1.b - lab2.b);
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 3 && argc != 4) {
+        std::println(" usage is 'flowbee_image_diff reference.png test.png [max_mean_delta_e]'");
+        return -1;
+    }
+
+    for (int i = 1; i < 3; ++i) {
+        if (!std::filesystem::exists(argv[i])) {
+            std::println("[error] '{}' does not exist", argv[i]);
+            return -1;
+        }
+    }
+
+    auto reference = flo::img_from_file(argv[1]);
+    auto test = flo::img_from_file(argv[2]);
+    if (reference.cols() != test.cols() || reference.rows() != test.rows()) {
+        std::println("[error] images differ in size: {}x{} vs. {}x{}",
+            reference.cols(), reference.rows(), test.cols(), test.rows());
+        return -1;
+    }
+
+    int max_channel_error = 0;
+    double sum_channel_error = 0.0;
+    double sum_squared_error = 0.0;
+    double max_delta_e = 0.0;
+    double sum_delta_e = 0.0;
+    int differing_pixels = 0;
+
+    for (auto [x, y] : flo::locations(reference.bounds())) {
+        auto c1 = flo::pixel_to_rgb(reference[x, y]);
+        auto c2 = flo::pixel_to_rgb(test[x, y]);
+        int errors[] = {
+            std::abs(c1.red - c2.red),
+            std::abs(c1.green - c2.green),
+            std::abs(c1.blue - c2.blue)
+        };
+        for (int err : errors) {
+            max_channel_error = std::max(max_channel_error, err);
+            sum_channel_error += err;
+            sum_squared_error += static_cast<double>(err) * err;
+        }
+        if (errors[0] || errors[1] || errors[2]) {
+            ++differing_pixels;
+            auto de = delta_e(c1, c2);
+            max_delta_e = std::max(max_delta_e, de);
+            sum_delta_e += de;
+        }
+    }
+
+    double num_pixels = static_cast<double>(reference.cols()) * reference.rows();
+    double mse = sum_squared_error / (3.0 * num_pixels);
+    double mean_delta_e = sum_delta_e / num_pixels;
+
+    std::println("  pixels differing:       {} of {} ({:.3f}%)",
+        differing_pixels, num_pixels, 100.0 * differing_pixels / num_pixels);
+    std::println("  max channel error:      {}", max_channel_error);
+    std::println("  mean channel error:     {:.5f}", sum_channel_error / (3.0 * num_pixels));
+    std::println("  rms channel error:      {:.5f}", std::sqrt(mse));
+    if (mse > 0.0) {
+        std::println("  psnr:                   {:.2f} dB", 10.0 * std::log10(255.0 * 255.0 / mse));
+    } else {
+        std::println("  psnr:                   inf");
+    }
+    std::println("  max delta E (CIE76):    {:.4f}", max_delta_e);
+    std::println("  mean delta E (CIE76):   {:.5f}", mean_delta_e);
+
+    if (argc == 4 && mean_delta_e > std::stod(argv[3])) {
+        std::println("[error] mean delta E exceeds {}", argv[3]);
+        return 1;
+    }
+
+    return 0;
+}